@@ -0,0 +1,476 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Benchmark Processes
+ */
+#include "global.h"
+#include "spede.h"
+#include "bench_proc.h"
+#include "syscall.h"
+#include "string.h"
+#include "kernel.h"
+#include "vdso.h"
+
+/**
+ * Reads the low 32 bits of the CPU time stamp counter
+ * @return number of CPU cycles (wraps around)
+ */
+static inline unsigned int bench_cycles() {
+    unsigned int lo;
+
+    asm volatile("rdtsc" : "=a"(lo) : : "edx");
+    return lo;
+}
+
+/**
+ * Repeatedly sleeps so the kernel can measure how long it takes to be
+ * dispatched after each wakeup (see the 's' debug command)
+ */
+void bench_wake_proc() {
+    int i;
+    int pid = get_proc_pid();
+
+    cons_printf("time=%04d pid=%02d bench_wake_proc started\n", get_sys_time(), pid);
+
+    for (i = 0; i < BENCH_WAKEUPS; i++) {
+        sleep(1);
+    }
+
+    cons_printf("time=%04d pid=%02d bench_wake_proc done (%d wakeups)\n", get_sys_time(), pid, i);
+    proc_exit();
+}
+
+/**
+ * Burns CPU time for BENCH_SECONDS and then exits
+ */
+void bench_hog_proc() {
+    int start_time = get_sys_time();
+
+    while (get_sys_time() - start_time < BENCH_SECONDS) {
+        // spin
+    }
+
+    proc_exit();
+}
+
+/**
+ * Sleeps for a while and then exits, so the timer interrupt cost can be
+ * measured with many processes on the sleep list
+ */
+void bench_sleep_proc() {
+    int i;
+
+    for (i = 0; i < BENCH_SECONDS; i++) {
+        sleep(get_proc_pid() % 3 + 1);
+    }
+
+    proc_exit();
+}
+
+/**
+ * Measures the cost of a system call made with the given interrupt
+ * @param  intr    - 0x80 (regular) or 0x81 (fast)
+ * @param  syscall - system call number; must not take arguments
+ * @return average CPU cycles per call
+ */
+static unsigned int bench_trap(int intr, int syscall) {
+    int i;
+    unsigned int start = bench_cycles();
+
+    for (i = 0; i < BENCH_CALLS; i++) {
+        if (intr == 0x80) {
+            asm volatile("movl %0, %%eax; int $0x80;" : : "g" (syscall) : "eax", "ebx", "ecx", "edx");
+        } else {
+            asm volatile("movl %0, %%eax; int $0x81;" : : "g" (syscall) : "eax", "ebx", "ecx", "edx");
+        }
+    }
+
+    return (bench_cycles() - start) / BENCH_CALLS;
+}
+
+/**
+ * Prints one benchmark result as cycles and calls per second
+ * @param what   - description of the path measured
+ * @param cycles - average CPU cycles per call
+ */
+static void bench_report(char *what, unsigned int cycles) {
+    if (cycles == 0) {
+        cycles = 1;
+    }
+
+    cons_printf("  %s: %u cycles, %u calls/s\n", what, cycles, vdso.tsc_khz / cycles * 1000);
+}
+
+/**
+ * Compares the cost of get_proc_pid and get_time_ns through the regular
+ * system call path (int 0x80), the fast path (int 0x81) and the shared
+ * kernel information page
+ */
+void bench_syscall_proc() {
+    int i;
+    unsigned int start;
+
+    cons_printf("pid=%02d system call round trips:\n", get_proc_pid());
+
+    bench_report("get_proc_pid int 0x80", bench_trap(0x80, SYSCALL_GET_PROC_PID));
+    bench_report("get_proc_pid int 0x81", bench_trap(0x81, SYSCALL_GET_PROC_PID));
+
+    start = bench_cycles();
+    for (i = 0; i < BENCH_CALLS; i++) {
+        get_proc_pid();
+    }
+    bench_report("get_proc_pid shared page", (bench_cycles() - start) / BENCH_CALLS);
+
+    bench_report("get_time_ns int 0x80", bench_trap(0x80, SYSCALL_GET_TIME_NS));
+    bench_report("get_time_ns int 0x81", bench_trap(0x81, SYSCALL_GET_TIME_NS));
+
+    start = bench_cycles();
+    for (i = 0; i < BENCH_CALLS; i++) {
+        get_time_ns();
+    }
+    bench_report("get_time_ns shared page", (bench_cycles() - start) / BENCH_CALLS);
+
+    start = bench_cycles();
+    for (i = 0; i < BENCH_CALLS; i++) {
+        get_sys_time();
+    }
+    bench_report("get_sys_time shared page", (bench_cycles() - start) / BENCH_CALLS);
+
+    proc_exit();
+}
+
+/**
+ * Sends BENCH_ROUND_TRIPS messages to bench_pong_proc and waits for each
+ * reply, then reports the round trip latency and message rate
+ */
+void bench_ping_proc() {
+    int i;
+    unsigned int start, cycles;
+    msg_t msg;
+
+    sp_memset(&msg, 0, sizeof(msg_t));
+
+    start = bench_cycles();
+    for (i = 0; i < BENCH_ROUND_TRIPS; i++) {
+        msg_send_len(&msg, BENCH_MSG_LEN, BENCH_MBOX_PING);
+        msg_recv(&msg, BENCH_MBOX_PONG);
+    }
+    cycles = (bench_cycles() - start) / BENCH_ROUND_TRIPS;
+
+    bench_report("ipc round trip", cycles);
+    cons_printf("  ipc messages: %u msgs/s\n", vdso.tsc_khz / (cycles ? cycles : 1) * 2000);
+
+    proc_exit();
+}
+
+/**
+ * Replies to every message from bench_ping_proc
+ */
+void bench_pong_proc() {
+    int i;
+    msg_t msg;
+
+    for (i = 0; i < BENCH_ROUND_TRIPS; i++) {
+        msg_send_len(&msg, msg_recv_len(&msg, BENCH_MBOX_PING), BENCH_MBOX_PONG);
+    }
+
+    proc_exit();
+}
+
+/**
+ * Sends BENCH_BATCH_MSGS messages with msg_sendv for each batch size from
+ * 1 to BENCH_BATCH_MAX (doubling), waiting for bench_batch_recv_proc to
+ * acknowledge each batch, and reports the message rate per batch size
+ */
+void bench_batch_send_proc() {
+    int i, batch, sent;
+    unsigned int start, cycles;
+    msg_t msg, ack;
+    msg_vec_t vec[BENCH_BATCH_MAX];
+
+    sp_memset(&msg, 0, sizeof(msg_t));
+    for (i = 0; i < BENCH_BATCH_MAX; i++) {
+        vec[i].msg = &msg;
+        vec[i].len = BENCH_MSG_LEN;
+    }
+
+    cons_printf("batched ipc, %d byte messages:\n", BENCH_MSG_LEN);
+
+    for (batch = 1; batch <= BENCH_BATCH_MAX; batch *= 2) {
+        start = bench_cycles();
+        for (sent = 0; sent < BENCH_BATCH_MSGS; sent += batch) {
+            msg_sendv(vec, batch, BENCH_MBOX_PING);
+            msg_recv_len(&ack, BENCH_MBOX_PONG);
+        }
+        cycles = (bench_cycles() - start) / BENCH_BATCH_MSGS;
+
+        cons_printf("  batch=%d: %u cycles/msg, %u msgs/s\n", batch, cycles,
+                    vdso.tsc_khz / (cycles ? cycles : 1) * 1000);
+    }
+
+    proc_exit();
+}
+
+/**
+ * Receives the batches sent by bench_batch_send_proc with msg_recvv and
+ * acknowledges each complete batch
+ */
+void bench_batch_recv_proc() {
+    int i, batch, received, got;
+    msg_t msg;
+    msg_vec_t vec[BENCH_BATCH_MAX];
+
+    for (i = 0; i < BENCH_BATCH_MAX; i++) {
+        vec[i].msg = &msg;
+    }
+
+    for (batch = 1; batch <= BENCH_BATCH_MAX; batch *= 2) {
+        for (i = 0; i < BENCH_BATCH_MSGS; i += batch) {
+            for (received = 0; received < batch; received += got) {
+                msg_recvv(vec, batch - received, BENCH_MBOX_PING, &got);
+            }
+            msg_send_len(&msg, 0, BENCH_MBOX_PONG);
+        }
+    }
+
+    proc_exit();
+}
+
+/**
+ * Compares uncontended lock/unlock pairs on a kernel semaphore (two system
+ * calls per pair) and on a futex-style semaphore (no system calls)
+ */
+void bench_sem_proc() {
+    int i;
+    unsigned int start;
+    sem_t sem = SEMAPHORE_UNINITIALIZED;
+    fsem_t fsem;
+
+    cons_printf("pid=%02d semaphore wait/post pairs:\n", get_proc_pid());
+
+    sem_init(&sem);
+    start = bench_cycles();
+    for (i = 0; i < BENCH_CALLS; i++) {
+        sem_wait(&sem);
+        sem_post(&sem);
+    }
+    bench_report("sem_wait/sem_post", (bench_cycles() - start) / BENCH_CALLS);
+
+    fsem_init(&fsem, 1);
+    start = bench_cycles();
+    for (i = 0; i < BENCH_CALLS; i++) {
+        fsem_wait(&fsem);
+        fsem_post(&fsem);
+    }
+    bench_report("fsem_wait/fsem_post", (bench_cycles() - start) / BENCH_CALLS);
+
+    proc_exit();
+}
+
+/**
+ * Prints a streaming throughput result
+ * @param what   - description of the transport measured
+ * @param cycles - CPU cycles taken to stream BENCH_STREAM_BYTES
+ */
+static void bench_stream_report(char *what, unsigned int cycles) {
+    cons_printf("  %s: %u cycles, %u KB/s\n", what, cycles,
+                (unsigned int)((unsigned long long)BENCH_STREAM_BYTES * vdso.tsc_khz / (cycles ? cycles : 1)));
+}
+
+/**
+ * Streams BENCH_STREAM_BYTES to bench_stream_recv_proc through a shared
+ * ring and then through msg_send, and reports the throughput of each
+ */
+void bench_stream_send_proc() {
+    int sent;
+    unsigned int start;
+    unsigned char buf[BENCH_STREAM_CHUNK];
+    msg_t msg, ack;
+    ring_t *ring = ring_attach(BENCH_RING);
+
+    sp_memset(buf, 0, sizeof(buf));
+    sp_memset(&msg, 0, sizeof(msg_t));
+
+    cons_printf("streaming %d bytes in %d byte chunks:\n", BENCH_STREAM_BYTES, BENCH_STREAM_CHUNK);
+
+    start = bench_cycles();
+    for (sent = 0; sent < BENCH_STREAM_BYTES; sent += BENCH_STREAM_CHUNK) {
+        ring_write(ring, buf, BENCH_STREAM_CHUNK);
+    }
+    msg_recv(&ack, BENCH_MBOX_PONG);                // everything was read
+    bench_stream_report("shared ring", bench_cycles() - start);
+
+    start = bench_cycles();
+    for (sent = 0; sent < BENCH_STREAM_BYTES; sent += BENCH_STREAM_CHUNK) {
+        msg_send_len(&msg, BENCH_STREAM_CHUNK, BENCH_MBOX_PING);
+    }
+    msg_recv(&ack, BENCH_MBOX_PONG);
+    bench_stream_report("msg_send/msg_recv", bench_cycles() - start);
+
+    proc_exit();
+}
+
+/**
+ * Receives the streams sent by bench_stream_send_proc and acknowledges
+ * the end of each one
+ */
+void bench_stream_recv_proc() {
+    int received;
+    unsigned char buf[BENCH_STREAM_CHUNK];
+    msg_t msg;
+    ring_t *ring = ring_attach(BENCH_RING);
+
+    sp_memset(&msg, 0, sizeof(msg_t));
+
+    for (received = 0; received < BENCH_STREAM_BYTES; received += BENCH_STREAM_CHUNK) {
+        ring_read(ring, buf, BENCH_STREAM_CHUNK);
+    }
+    msg_send_len(&msg, 0, BENCH_MBOX_PONG);
+
+    received = 0;
+    while (received < BENCH_STREAM_BYTES) {
+        received += msg_recv_len(&msg, BENCH_MBOX_PING);
+    }
+    msg_send_len(&msg, 0, BENCH_MBOX_PONG);
+
+    proc_exit();
+}
+
+/**
+ * Burns CPU time for BENCH_SCALE_SECONDS and then exits. The scaling
+ * benchmark starts more of these each run, so the scheduler is measured
+ * with a growing number of runnable processes.
+ */
+void bench_scale_proc() {
+    int start_time = get_sys_time();
+
+    while (get_sys_time() - start_time < BENCH_SCALE_SECONDS) {
+        // spin
+    }
+
+    proc_exit();
+}
+
+/**
+ * Sleeps and wakes up while the scaling benchmark's processes compete for
+ * the CPU, then reports the scheduler's pick cost and wakeup latency
+ */
+void bench_scale_report_proc() {
+    int i;
+
+    for (i = 0; i < BENCH_WAKEUPS; i++) {
+        sleep_ms(100);
+    }
+
+    cons_printf("  schedule: %u cycles avg, %u max (%u picks)\n",
+                sched_stats.picks ? (unsigned int)(sched_stats.pick_cycles / sched_stats.picks) : 0,
+                sched_stats.pick_cycles_max, sched_stats.picks);
+    cons_printf("  wakeup latency: %d ticks avg, %d max\n",
+                sched_stats.wakeups ? sched_stats.latency_total / sched_stats.wakeups : 0,
+                sched_stats.latency_max);
+
+    proc_exit();
+}
+
+/**
+ * Checks that a subscriber that exits without unsubscribing does not keep
+ * its topic subscription: once it is gone, publishing more messages than
+ * a subscriber queue holds must still succeed
+ */
+void bench_topic_exit_proc() {
+    int i, rc;
+    msg_t msg;
+
+    sp_memset(&msg, 0, sizeof(msg_t));
+    topic_subscribe(BENCH_TOPIC);
+
+    // Wait until bench_topic_sub_proc has subscribed, then give it time to exit
+    msg_recv(&msg, BENCH_MBOX_PONG);
+    sleep_ms(100);
+
+    for (i = 0; i <= TOPIC_DEPTH; i++) {
+        rc = topic_publish(&msg, BENCH_MSG_LEN, BENCH_TOPIC);
+        if (rc != MSG_OK) {
+            break;
+        }
+        topic_recv(&msg, BENCH_TOPIC);
+    }
+
+    topic_unsubscribe(BENCH_TOPIC);
+    cons_printf("topic exit test: %s (%d of %d publishes accepted)\n",
+                i > TOPIC_DEPTH ? "passed" : "FAILED", i, TOPIC_DEPTH + 1);
+
+    proc_exit();
+}
+
+/**
+ * Subscriber started with bench_topic_exit_proc: subscribes and exits
+ * without unsubscribing
+ */
+void bench_topic_sub_proc() {
+    msg_t msg;
+
+    topic_subscribe(BENCH_TOPIC);
+    msg_send_len(&msg, 0, BENCH_MBOX_PONG);
+
+    proc_exit();
+}
+
+/**
+ * Fills BENCH_FORK_PAGES pages of the data window, then compares copying
+ * them with starting a worker that shares them copy-on-write (proc_fork)
+ */
+void bench_fork_proc() {
+    int i;
+    unsigned int start, cycles;
+    unsigned char *data = (unsigned char *)PROC_DATA_BASE;
+    msg_t msg;
+
+    cons_printf("fork benchmark: %d pages\n", BENCH_FORK_PAGES);
+
+    // Touch the pages and the copy destination so only the copy itself is timed below
+    start = bench_cycles();
+    sp_memset(data, BENCH_FORK_MARK, 2 * BENCH_FORK_PAGES * KPAGE_SIZE);
+    cons_printf("  first touch: %u cycles/page\n", (bench_cycles() - start) / (2 * BENCH_FORK_PAGES));
+
+    start = bench_cycles();
+    for (i = 0; i < BENCH_FORK_ROUNDS; i++) {
+        sp_memcpy(data + BENCH_FORK_PAGES * KPAGE_SIZE, data, BENCH_FORK_PAGES * KPAGE_SIZE);
+    }
+    cons_printf("  memcpy: %u cycles\n", (bench_cycles() - start) / BENCH_FORK_ROUNDS);
+
+    cycles = 0;
+    for (i = 0; i < BENCH_FORK_ROUNDS; i++) {
+        start = bench_cycles();
+        if (proc_fork(bench_fork_child) < 0) {
+            cons_printf("  proc_fork failed\n");
+            proc_exit();
+        }
+        cycles += bench_cycles() - start;
+
+        msg_recv(&msg, BENCH_MBOX_PONG);
+        if (msg.data[0] != BENCH_FORK_MARK || data[0] != BENCH_FORK_MARK) {
+            cons_printf("  worker and parent data mixed up\n");
+        }
+    }
+    cons_printf("  proc_fork: %u cycles\n", cycles / BENCH_FORK_ROUNDS);
+
+    proc_exit();
+}
+
+/**
+ * Worker started by bench_fork_proc: reports what it sees in the shared
+ * data window, then writes to it, which gives it a private copy of the page
+ */
+void bench_fork_child() {
+    unsigned char *data = (unsigned char *)PROC_DATA_BASE;
+    msg_t msg;
+
+    msg.data[0] = data[0];
+    data[0] = 0;
+    msg_send_len(&msg, 1, BENCH_MBOX_PONG);
+
+    proc_exit();
+}
@@ -0,0 +1,68 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Benchmark Processes
+ */
+#ifndef BENCH_PROC_H
+#define BENCH_PROC_H
+
+#define BENCH_HOGS 19                   // CPU hogs started by the latency benchmark
+#define BENCH_SECONDS 20                // How long each CPU hog runs
+#define BENCH_WAKEUPS 15                // Number of sleep/wake cycles to measure
+#define BENCH_CALLS 10000               // Number of calls per microbenchmark
+#define BENCH_ROUND_TRIPS 1000          // Number of IPC ping-pong round trips
+#define BENCH_MBOX_PING 2               // Mailbox the ping process sends to
+#define BENCH_MBOX_PONG 3               // Mailbox the pong process replies to
+#define BENCH_MSG_LEN 16                // Message data bytes sent by the benchmarks
+#define BENCH_BATCH_MAX 32              // Largest batch size in the batched IPC sweep
+#define BENCH_BATCH_MSGS 1024           // Messages sent for each batch size
+#define BENCH_RING 0                    // Shared ring used by the streaming benchmark
+#define BENCH_STREAM_BYTES 1048576      // Bytes streamed through each transport
+#define BENCH_STREAM_CHUNK 256          // Bytes written or sent at a time
+#define BENCH_SCALE_STEP 32             // Runnable processes added by each run of the scaling benchmark
+#define BENCH_SCALE_SECONDS 60          // How long each of the scaling benchmark's processes runs
+#define BENCH_TOPIC 1                   // Topic used by the topic exit test
+#define BENCH_FORK_PAGES 64             // Data window pages shared (or copied) by the fork benchmark
+#define BENCH_FORK_ROUNDS 16            // Workers started by the fork benchmark
+#define BENCH_FORK_MARK 0x5A            // Byte the fork benchmark fills its pages with
+
+// Scheduler latency benchmark
+void bench_wake_proc();
+void bench_hog_proc();
+
+// Timer tick cost benchmark
+void bench_sleep_proc();
+
+// System call round trip benchmark
+void bench_syscall_proc();
+
+// IPC ping-pong benchmark
+void bench_ping_proc();
+void bench_pong_proc();
+
+// Batched IPC throughput benchmark
+void bench_batch_send_proc();
+void bench_batch_recv_proc();
+
+// Semaphore fast path benchmark
+void bench_sem_proc();
+
+// Streaming throughput benchmark
+void bench_stream_send_proc();
+void bench_stream_recv_proc();
+
+// Process table scaling benchmark
+void bench_scale_proc();
+void bench_scale_report_proc();
+
+// Topic subscriber exit test
+void bench_topic_exit_proc();
+void bench_topic_sub_proc();
+
+// Copy-on-write fork benchmark
+void bench_fork_proc();
+void bench_fork_child();
+
+#endif
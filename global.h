@@ -9,9 +9,14 @@
 #define GLOBAL_H
 
 // Maximum number of processes we will support
-#define PROC_MAX 20
+#define PROC_MAX 256
 #define PROC_NAME_LEN 32
 
+// Private data window of each process: pages appear on first touch and
+// are shared copy-on-write with workers started by proc_fork
+#define PROC_DATA_BASE 0x40000000
+#define PROC_DATA_SIZE 0x400000
+
 // Number of times to loop over IO_DELAY() to delay for one second
 #define IO_DELAY_LOOP 1666666
 
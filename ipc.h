@@ -9,9 +9,65 @@ typedef enum {
 
 typedef int sem_t;
 
+// Semaphore return codes
+typedef enum {
+    SEM_OK = 0,
+    SEM_ERR_BUSY = -1,              // Semaphore is taken (sem_trywait)
+    SEM_ERR_TIMEOUT = -2,           // Not taken in time (sem_timedwait), same as IPC_TIMEOUT
+    SEM_ERR_DESTROYED = -3          // Semaphore was destroyed while waiting
+} sem_err_e;
+
+// Mutex definitions
+typedef enum {
+    MUTEX_UNINITIALIZED = -1,
+    MUTEX_INITIALIZED = 1
+} mutex_state_e;
+
+typedef int mutex_t;
+
+// Condition variable definitions
+typedef enum {
+    COND_UNINITIALIZED = -1,
+    COND_INITIALIZED = 1
+} cond_state_e;
+
+typedef int cond_t;
+
+// Reader-writer lock definitions
+typedef enum {
+    RWLOCK_UNINITIALIZED = -1,
+    RWLOCK_INITIALIZED = 1
+} rwlock_state_e;
+
+typedef int rwlock_t;
+
+// Futex-style semaphore: the count lives in user memory and is updated with
+// atomic instructions, the kernel is only entered to block or wake a waiter
+typedef struct fsem_t {
+    volatile int count;             // Units available
+    volatile int waiters;           // Processes blocked or about to block
+} fsem_t;
+
 // Message definitions
 #define MSG_SIZE 256
 
+// Message priority bands, MSG_PRIO_HIGH is received first
+#define MSG_PRIO_LEVELS 4
+#define MSG_PRIO_HIGH 0
+#define MSG_PRIO_DEFAULT 2
+#define MSG_PRIO_LOW (MSG_PRIO_LEVELS - 1)
+
+// Result of a timed wait that ran out
+#define IPC_TIMEOUT -2
+
+// Message passing return codes
+typedef enum {
+    MSG_OK = 0,
+    MSG_ERR_FULL = -1,              // Mailbox has no room (msg_trysend)
+    MSG_ERR_TIMEOUT = IPC_TIMEOUT,  // No message arrived in time (msg_recv_timeout)
+    MSG_ERR_EMPTY = -3              // Mailbox has no message (msg_tryrecv)
+} msg_err_e;
+
 // Message data structure
 typedef struct msg_t {
     int sender;                     // Sending PID
@@ -20,4 +76,23 @@ typedef struct msg_t {
     unsigned char data[MSG_SIZE];   // Message data
 } msg_t;
 
+// Single-producer/single-consumer byte ring shared by two processes
+// head and tail count bytes read and written (they wrap around freely);
+// each side only writes its own index, so no locks are needed
+#define RING_BYTES 4096             // Ring data size, a power of two
+
+typedef struct ring_t {
+    volatile unsigned int head;     // Bytes read, written by the consumer
+    volatile unsigned int tail;     // Bytes written, written by the producer
+    volatile int reader_waiting;    // Consumer is (about to be) blocked on tail
+    volatile int writer_waiting;    // Producer is (about to be) blocked on head
+    unsigned char data[RING_BYTES]; // Ring data
+} ring_t;
+
+// Message vector entry for batched send/receive
+typedef struct msg_vec_t {
+    msg_t *msg;                     // Message
+    int len;                        // Length of the message data
+} msg_vec_t;
+
 #endif
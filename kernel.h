@@ -16,75 +16,330 @@
 
 // Global Definitions******************
 
-#define PID_MAX PROC_MAX-1                                      // Maximum process ID possible (0-based PIDs)
-#define PROC_STACK_SIZE 8196                                    // Process runtime stack size
+#define PID_MAX 1023                                            // Maximum process ID possible (0-based PIDs, handed out in turn)
+#define PROC_STACK_SIZE 8192                                    // Default process runtime stack size (a multiple of KPAGE_SIZE)
 #define PROC_TICKS_MAX 50                                       // Maximum number of ticks a process may run before being rescheduled
-#define SEMAPHORE_MAX PROC_MAX                                  // Maximum number of semaphores
-#define MBOX_MAX PROC_MAX                                       // Maximum number of mailboxes
-#define MBOX_SIZE PROC_MAX                                      // Size of each mailboxes
+#define PRIO_LEVELS 8                                           // Number of scheduler priority levels (0 is the highest)
+#define PRIO_HIGH 0                                             // Highest priority level
+#define PRIO_DEFAULT 2                                          // Priority level new user processes start at
+#define PRIO_LOW (PRIO_LEVELS-2)                                // Lowest level a user process can be demoted to
+#define PRIO_IDLE (PRIO_LEVELS-1)                               // Level reserved for the kernel idle task
+#define PRIO_TICKS(p) (PROC_TICKS_MAX * ((p) + 1) / PRIO_IDLE)  // Time slice (ticks) for a priority level
+#define SEMAPHORE_MAX 20                                        // Maximum number of semaphores
+#define MBOX_MAX 20                                             // Maximum number of mailboxes
+#define MBOX_BYTES 2048                                         // Size of each mailbox ring (bytes)
+#define MUTEX_MAX 20                                            // Maximum number of mutexes
+#define COND_MAX 20                                             // Maximum number of condition variables
+#define RWLOCK_MAX 20                                           // Maximum number of reader-writer locks
+#define RING_MAX 4                                              // Number of shared rings
+#define KPAGE_SIZE 4096                                         // Size of a page handed out by the page allocator
+#define KPAGE_PROC (1 + KVM_IDENT_PTS + PROC_STACK_SIZE / KPAGE_SIZE)  // Most pages a process takes: page directory, private identity page tables, default stack
+#define KPAGE_SPARE 256                                         // Pages for object caches, shared memory and process data
+#define KPAGE_COUNT (PROC_MAX * KPAGE_PROC + KPAGE_SPARE)        // Pages managed by the page allocator, enough for PROC_MAX processes
+#define SHM_MAX 8                                               // Maximum number of shared memory segments
+#define SHM_NAME_LEN 15                                         // Longest shared memory segment name
+#define TOPIC_MAX 4                                             // Number of publish/subscribe topics
+#define TOPIC_SUBS 8                                            // Subscribers per topic
+#define TOPIC_DEPTH 8                                           // Messages queued per subscriber
+#define TOPIC_BUFS 32                                           // Shared topic message buffers
+#define FUTEX_BUCKETS 16                                        // Futex wait queues, hashed by address
+#define KSLAB_PAGES_MAX 4                                       // Largest slab an object cache takes at once (pages)
+#define KVM_ENTRIES 1024                                        // Entries in a page directory or page table
+#define KVM_IDENT_PTS 4                                         // Page tables identity mapping the first 16 MB (kernel, video memory and the page pool)
 
 /**
  * Kernel data types and definitions
  */
 
+// System time in timer ticks (64-bit so it never wraps)
+typedef long long tick_t;
+
 // Process states
 typedef enum { AVAILABLE, READY, RUNNING, SLEEPING, WAITING} state_t;
 
+// Run or wait queue of processes, linked through their PCBs
+typedef struct {
+    int head;                       // First process, -1 if empty
+    int tail;                       // Last process, -1 if empty
+    int size;                       // Number of processes
+} kqueue_t;
+
 // The process control block for each process
 typedef struct {
     char name[PROC_NAME_LEN+1];     // Process name/title
     state_t state;                  // current process state
-    queue_t *queue;                 // queue the process belongs to
+    kqueue_t *queue;                // queue the process belongs to, NULL if none
+    int queue_prev;                 // previous process in the queue, -1 if first
+    int queue_next;                 // next process in the queue, -1 if last
     int time;                       // run time since loaded
     int total_time;                 // total run time since created
     trapframe_t *trapframe_p;       // process trapframe
-	int wake_time;					// time when proc. is done sleeping
+    unsigned char *stack;           // runtime stack, from the page allocator
+    int stack_pages;                // pages in the runtime stack
+    unsigned int *page_dir;         // page directory, loaded into CR3 while the process runs
+	tick_t wake_time;				// time when proc. is done sleeping
+    int sleep_prev;                 // previous process in the sleep list, -1 if none
+    int sleep_next;                 // next process in the sleep list, -1 if none
+    void (*timeout_fn)(int pid);    // called to leave select queues if a timed wait expires
+    unsigned int select_mask;       // bit n set while on the select queue of mailbox n
+    unsigned char shm_refs[SHM_MAX]; // times the process created or attached each shared memory segment
+    int select_prev[MBOX_MAX];      // previous process in each mailbox's select queue, -1 if first
+    int select_next[MBOX_MAX];      // next process in each mailbox's select queue, -1 if last
+    int priority;                   // current scheduling priority level
+    tick_t ready_time;              // time when woken up, -1 if not woken
+    int base_priority;              // priority to return to after inheriting one, -1 if not inherited
+    int mutex_wait;                 // mutex the process is blocked on, -1 if none
+    unsigned long long block_time;  // time stamp counter when it blocked on the mutex
 } pcb_t;
 
 //Syscall definitions
 typedef enum{
 	SYSCALL_PROC_EXIT,
-	SYSCALL_GET_SYS_TIME,
+	SYSCALL_GET_TIME_NS,
 	SYSCALL_GET_PROC_PID,
 	SYSCALL_GET_PROC_NAME,
-	SYSCALL_SLEEP,
+	SYSCALL_SLEEP_MS,
     SYSCALL_SEM_INIT,
     SYSCALL_SEM_WAIT,
     SYSCALL_SEM_POST,
     SYSCALL_MSG_SEND,
-    SYSCALL_MSG_RECV
+    SYSCALL_MSG_RECV,
+    SYSCALL_SLEEP_US,
+    SYSCALL_MSG_SENDV,
+    SYSCALL_MSG_RECVV,
+    SYSCALL_MSG_TRYSEND,
+    SYSCALL_MSG_RECV_TIMEOUT,
+    SYSCALL_MSG_TRYRECV,
+    SYSCALL_MSG_SELECT,
+    SYSCALL_FUTEX_WAIT,
+    SYSCALL_FUTEX_WAKE,
+    SYSCALL_MUTEX_INIT,
+    SYSCALL_MUTEX_LOCK,
+    SYSCALL_MUTEX_UNLOCK,
+    SYSCALL_COND_INIT,
+    SYSCALL_COND_WAIT,
+    SYSCALL_COND_SIGNAL,
+    SYSCALL_COND_BROADCAST,
+    SYSCALL_RWLOCK_INIT,
+    SYSCALL_RWLOCK_RDLOCK,
+    SYSCALL_RWLOCK_WRLOCK,
+    SYSCALL_RWLOCK_UNLOCK,
+    SYSCALL_SEM_TRYWAIT,
+    SYSCALL_SEM_TIMEDWAIT,
+    SYSCALL_SEM_DESTROY,
+    SYSCALL_RING_ATTACH,
+    SYSCALL_SHM_CREATE,
+    SYSCALL_SHM_ATTACH,
+    SYSCALL_SHM_DETACH,
+    SYSCALL_TOPIC_SUBSCRIBE,
+    SYSCALL_TOPIC_UNSUBSCRIBE,
+    SYSCALL_TOPIC_PUBLISH,
+    SYSCALL_TOPIC_RECV,
+    SYSCALL_MSG_SEND_PRIO,
+    SYSCALL_PROC_FORK,
+    SYSCALL_COUNT                   // Number of system calls (must be last)
 }syscall_t;
 
 // Semaphore data structure
 typedef struct {
     int count;                      // Semaphore count
-    int init;                       // Indicates if initialized
-    queue_t wait_q;                 // Wait queue for the semaphore
+    kqueue_t wait_q;                // Wait queue for the semaphore
 } semaphore_t;
 
+// Mutex data structure
+typedef struct {
+    int owner;                      // PID holding the mutex, -1 if unlocked
+    int init;                       // Indicates if initialized
+    kqueue_t wait_q;                // Processes waiting for the mutex
+    unsigned long long lock_time;   // Time stamp counter when the owner took it
+    unsigned int locks;             // Times the mutex was taken
+    unsigned int contended;         // Times a process had to wait for it
+    unsigned long long hold_total;  // Total CPU cycles the mutex was held
+    unsigned long long hold_max;    // Longest hold (CPU cycles)
+    unsigned long long block_max;   // Longest wait for the mutex (CPU cycles)
+} kmutex_t;
+
+// Condition variable data structure
+typedef struct {
+    int init;                       // Indicates if initialized
+    kqueue_t wait_q;                // Processes waiting to be signaled
+} kcond_t;
+
+// Reader-writer lock data structure
+typedef struct {
+    int init;                       // Indicates if initialized
+    int readers;                    // Processes holding the lock for reading
+    int writer;                     // PID holding the lock for writing, -1 if none
+    kqueue_t read_q;                // Processes waiting to read
+    kqueue_t write_q;               // Processes waiting to write
+} krwlock_t;
+
+// Mailbox message record header, followed by len bytes of message data
+typedef struct {
+    int sender;                     // Sending PID
+    int time_sent;                  // Time sent
+    int len;                        // Length of the message data
+    int prio;                       // Priority band
+    int next;                       // Offset of the next record in the band, -1 if last
+    unsigned int tsc;               // Time stamp counter (low 32 bits) when queued
+} mbox_rec_t;
+
 // Mailbox data structures
 typedef struct {
-    msg_t messages[MBOX_SIZE]; // Incoming messages
-    int head;                       // First message
-    int tail;                       // Last message
+    unsigned char ring[MBOX_BYTES]; // Incoming message records
+    int head;                       // Offset of the first record
+    int tail;                       // Offset where the next record is written
+    int used;                       // Bytes in use
     int size;                       // Total messages
-    queue_t wait_q;                 // Processes waiting for messages
+    int band_head[MSG_PRIO_LEVELS]; // Offset of the oldest record in each band, -1 if empty
+    int band_tail[MSG_PRIO_LEVELS]; // Offset of the newest record in each band, -1 if empty
+    unsigned int band_bitmap;       // Bit n set when band n has messages
+    kqueue_t wait_q;                // Processes waiting for messages
+    kqueue_t send_q;                // Processes waiting for room to send
+    kqueue_t select_q;              // Processes in msg_select waiting on this mailbox (and others), linked through select_prev/select_next
 } mailbox_t;
 
+// Reference counted topic message buffer
+typedef struct {
+    int refs;                       // Subscribers that have not consumed it, 0 if free
+    int next;                       // Next free buffer, -1 if none
+    int sender;                     // Publishing PID
+    int time_sent;                  // Time published
+    int len;                        // Length of the message data
+    unsigned char data[MSG_SIZE];   // Message data
+} topic_buf_t;
+
+// Subscription of one process to a topic
+typedef struct {
+    int pid;                        // Subscribed PID, -1 if the slot is free
+    int bufs[TOPIC_DEPTH];          // Buffers waiting to be consumed
+    int head;                       // First buffer waiting
+    int size;                       // Buffers waiting
+} topic_sub_t;
+
+// Publish/subscribe topic
+typedef struct {
+    int subs;                       // Number of subscribers
+    topic_sub_t sub[TOPIC_SUBS];    // Subscriptions
+    kqueue_t wait_q;                // Subscribers waiting for a message
+    unsigned int published;         // Messages published
+    unsigned int dropped;           // Publishes refused for lack of room
+} topic_t;
+
+// Named shared memory segment
+typedef struct {
+    char name[SHM_NAME_LEN+1];      // Segment name, empty if the slot is free
+    int size;                       // Size requested (bytes)
+    int pages;                      // Pages backing the segment
+    void *addr;                     // First page
+    int refs;                       // Processes attached (the creator counts)
+} shm_t;
+
+// Page allocator statistics
+typedef struct {
+    int used;                       // Pages allocated
+    int peak;                       // Most pages ever allocated at once
+    int failed;                     // Allocations that found no room
+} kpage_stats_t;
+
+// Object cache (slab allocator) for one type of kernel object
+typedef struct {
+    char *name;                     // Name shown in the statistics
+    int obj_size;                   // Object size, rounded up to a pointer
+    int slab_pages;                 // Pages in each slab
+    int per_slab;                   // Objects cut from each slab
+    void *free;                     // First free object, NULL if none
+    int slabs;                      // Slabs taken from the page allocator
+    int live;                       // Objects handed out
+    int peak;                       // Most objects handed out at once
+    int failed;                     // Allocations that found no memory
+    int table_count;                // Objects in the static table the cache replaced
+} kslab_t;
+
+// Paging statistics
+typedef struct {
+    unsigned int zero_fills;        // Data pages allocated on first touch
+    unsigned int cow_copies;        // Shared pages copied on a write
+    unsigned int cow_reuses;        // Shared pages taken over by their last sharer
+    unsigned int forks;             // Processes started by proc_fork
+    unsigned int shared;            // Pages shared by proc_fork instead of copied
+    unsigned int killed;            // Processes killed by a bad page fault or system call argument
+} kvm_stats_t;
+
+// Message queueing delay statistics for one priority band
+typedef struct {
+    unsigned int msgs;              // Messages received
+    unsigned long long delay_total; // Total time spent queued (CPU cycles)
+    unsigned long long delay_max;   // Longest time spent queued (CPU cycles)
+} msg_prio_stats_t;
+
+// Scheduler statistics
+typedef struct {
+    int wakeups;                    // Processes dispatched after being woken up
+    int latency_total;              // Sum of wakeup-to-run latency (ticks)
+    int latency_max;                // Worst wakeup-to-run latency (ticks)
+    unsigned int picks;             // Times the scheduler picked the next process
+    unsigned long long pick_cycles; // Total CPU cycles spent picking
+    unsigned int pick_cycles_max;   // Slowest pick (CPU cycles)
+} sched_stats_t;
+
+// Timer interrupt statistics, indexed by the number of sleeping processes
+typedef struct {
+    unsigned int ticks[PROC_MAX+1];         // Timer interrupts handled
+    unsigned int cycles[PROC_MAX+1];        // Total CPU cycles spent in the timer ISR
+    unsigned int cycles_max[PROC_MAX+1];    // Worst case CPU cycles for one tick
+} timer_stats_t;
+
 /**
  * Kernel data structures - available to the entire kernel
  */
 
-extern char stack[PROC_MAX][PROC_STACK_SIZE];                   // runtime stacks of processes
-extern pcb_t pcb[PROC_MAX];                                     // process table
-extern int system_time;                                         // System time
+extern pcb_t *pcb[PID_MAX+1];                                   // process table indexed by PID, NULL if the PID is unused
+extern int pid_next;                                            // Next process ID to try handing out
+extern tick_t system_time;                                      // System time (ticks since boot)
+extern unsigned long long tsc_boot;                             // Time stamp counter value at boot
+extern unsigned int tsc_khz;                                    // Time stamp counter frequency (kHz)
 extern int run_pid;                                             // ID of running process, -1 means not set
-extern semaphore_t semaphores[SEMAPHORE_MAX];                   // Semaphore DT
-extern mailbox_t mailboxes[MBOX_MAX];                           // mailbox DT
+extern semaphore_t *semaphores[SEMAPHORE_MAX];                  // Semaphore DT, NULL if not initialized
+extern mailbox_t *mailboxes[MBOX_MAX];                          // mailbox DT, NULL until first used
+extern kmutex_t mutexes[MUTEX_MAX];                             // mutex DT
+extern kcond_t conds[COND_MAX];                                 // condition variable DT
+extern krwlock_t rwlocks[RWLOCK_MAX];                           // reader-writer lock DT
+extern ring_t rings[RING_MAX];                                  // shared SPSC rings
+extern shm_t shm_segs[SHM_MAX];                                 // shared memory segments
+extern topic_t topics[TOPIC_MAX];                               // publish/subscribe topics
+extern topic_buf_t topic_bufs[TOPIC_BUFS];                      // topic message buffers
+extern int topic_free;                                          // First free topic buffer, -1 if none
+extern unsigned char kpages[KPAGE_COUNT][KPAGE_SIZE];           // memory handed out by the page allocator
+extern unsigned int kpage_bitmap[(KPAGE_COUNT + 31) / 32];      // Bit n set when page n is allocated
+extern kpage_stats_t kpage_stats;                               // Page allocator statistics
+extern unsigned short kpage_refs[KPAGE_COUNT];                  // Page tables mapping each process data page
+extern unsigned int kvm_kernel_pd[KVM_ENTRIES];                 // Kernel page directory, loaded on every interrupt
+extern unsigned int kvm_ident_pt[KVM_IDENT_PTS][KVM_ENTRIES];   // Page tables identity mapping low memory
+extern unsigned int kvm_fault_code;                             // Error code of the last page fault
+extern kvm_stats_t kvm_stats;                                   // Paging statistics
+extern kslab_t pcb_cache;                                       // Process control blocks
+extern kslab_t sem_cache;                                       // Semaphores
+extern kslab_t mbox_cache;                                      // Mailboxes
+
+extern sched_stats_t sched_stats;                               // Scheduler statistics
+extern timer_stats_t timer_stats;                               // Timer interrupt statistics
+extern msg_prio_stats_t msg_prio_stats[MSG_PRIO_LEVELS];        // Message queueing delay per priority band
+extern int sleep_head;                                          // First process in the sleep list, -1 if empty
+extern int sleep_count;                                         // Number of sleeping processes
+extern int tickless;                                            // Stop the timer tick while idle when set
+extern int tickless_ticks;                                      // Ticks covered by the pending one-shot timer, 0 if periodic
+extern unsigned int ticks_skipped;                              // Timer interrupts avoided by tickless idle
+extern int ipc_direct_switch;                                   // Switch straight to a waiting receiver on msg_send
 
 // *****Queues*****
-extern queue_t available_q, run_q, idle_q, sleep_q;             // Process queues
+extern kqueue_t prio_q[PRIO_LEVELS];                            // Run queues, one per priority level
+extern unsigned int prio_bitmap;                                // Bit n set when prio_q[n] is non-empty
 extern queue_t semaphore_q;                                     // Semaphore Queue
+extern queue_t mutex_q;                                         // Mutex Queue
+extern queue_t cond_q;                                          // Condition Variable Queue
+extern queue_t rwlock_q;                                        // Reader-Writer Lock Queue
+extern kqueue_t futex_q[FUTEX_BUCKETS];                         // Processes blocked in futex_wait
 
 
 /**
@@ -13,15 +13,20 @@
 #include "queue.h"
 #include "string.h"
 #include "ksyscall.h"
+#include "ktimer.h"
+#include "vdso.h"
+#include "kvm.h"
+#include "ipc.h"
 
 /**
  * Kernel Interrupt Service Routine: Timer (IRQ 0)
  */
 void kisr_timer() {
 	
-    //Variables for wake and processID
-    int wakeProcess, i = 0;
-    system_time++;                                                        // Increment the system time
+    //Variable for the process being rescheduled
+    int wakeProcess;
+    system_time += ktimer_tickless_exit();                                // Advance the system time (more than one tick after tickless idle)
+    vdso_update_time();                                                   // Publish it to the shared page
 
     // If the running PID is invalid, just return
     if (run_pid == -1) {
@@ -32,38 +37,28 @@ void kisr_timer() {
 
     }
 	
-	//CHECK THIS FUNCTION CONDITION - changed acc. to demo code
-    //determine what processes should be woken up from the sleep_q
-    while(i < sleep_q.size){
-
-        if(dequeue(&sleep_q, &wakeProcess) != 0){
-
-            panic("Error! Unable to get process from the sleep_q");
-
-        } 
-        if(pcb[wakeProcess].wake_time <= system_time){
-            if(enqueue(pcb[wakeProcess].queue, wakeProcess) != 0)
-                panic("Error! Unable to add process to the run_q");
-            pcb[wakeProcess].state = READY;
-        }
-        else
-            if(enqueue(&sleep_q, wakeProcess) != 0)
-                panic("Error! Unable to add process to the sleep_q");
-        
-        i++;
+    // Wake up the processes whose wake time has been reached
+    ktimer_expire();
+
+    // A woken process may have preempted the running process
+    if (run_pid == -1) {
+
+        outportb(0x20, 0x60);                                           // Dismiss IRQ 0 (Timer)
+        return;
 
     }
 
-    pcb[run_pid].time++;                                                // Increment the running process' current run time
+    pcb[run_pid]->time++;                                               // Increment the running process' current run time
 
-    // Once the running process has exceeded the maximum number of ticks, it needs to be unscheduled:
-    if (pcb[run_pid].time >= PROC_TICKS_MAX) {
+    // Once the running process has used up the time slice for its priority level, it needs to be unscheduled:
+    if (pcb[run_pid]->time >= PRIO_TICKS(pcb[run_pid]->priority)) {
 
-        pcb[run_pid].total_time += pcb[run_pid].time;                   // set the total run time
-        pcb[run_pid].time  = 0;                                         // reset the current running time
-        pcb[run_pid].state = READY;                                     // set the state to ready
-        enqueue(pcb[run_pid].queue, run_pid);                           // queue the process back into the runnning queue
+        pcb[run_pid]->total_time += pcb[run_pid]->time;                 // set the total run time
+        pcb[run_pid]->time  = 0;                                        // reset the current running time
+        wakeProcess = run_pid;
         run_pid = -1;                                                   // clear the running pid
+        kproc_demote(wakeProcess);                                      // CPU-bound processes sink to lower levels
+        kproc_ready(wakeProcess);                                       // queue the process back into its run queue
 
     }
 
@@ -71,34 +66,209 @@ void kisr_timer() {
 
 }
 
+/**
+ * System call dispatch table, indexed by syscall_t
+ */
+static func_ptr_t syscall_table[SYSCALL_COUNT] = {
+    [SYSCALL_PROC_EXIT]     = kproc_exit,
+    [SYSCALL_GET_TIME_NS]   = ksyscall_get_time_ns,
+    [SYSCALL_GET_PROC_PID]  = ksyscall_get_proc_pid,
+    [SYSCALL_GET_PROC_NAME] = ksyscall_get_proc_name,
+    [SYSCALL_SLEEP_MS]      = ksyscall_sleep_ms,
+    [SYSCALL_SEM_INIT]      = ksyscall_sem_init,
+    [SYSCALL_SEM_WAIT]      = ksyscall_sem_wait,
+    [SYSCALL_SEM_POST]      = ksyscall_sem_post,
+    [SYSCALL_MSG_SEND]      = ksyscall_msg_send,
+    [SYSCALL_MSG_RECV]      = ksyscall_msg_recv,
+    [SYSCALL_SLEEP_US]      = ksyscall_sleep_us,
+    [SYSCALL_MSG_SENDV]     = ksyscall_msg_sendv,
+    [SYSCALL_MSG_RECVV]     = ksyscall_msg_recvv,
+    [SYSCALL_MSG_TRYSEND]   = ksyscall_msg_trysend,
+    [SYSCALL_MSG_RECV_TIMEOUT] = ksyscall_msg_recv_timeout,
+    [SYSCALL_MSG_TRYRECV]   = ksyscall_msg_tryrecv,
+    [SYSCALL_MSG_SELECT]    = ksyscall_msg_select,
+    [SYSCALL_FUTEX_WAIT]    = ksyscall_futex_wait,
+    [SYSCALL_FUTEX_WAKE]    = ksyscall_futex_wake,
+    [SYSCALL_MUTEX_INIT]    = ksyscall_mutex_init,
+    [SYSCALL_MUTEX_LOCK]    = ksyscall_mutex_lock,
+    [SYSCALL_MUTEX_UNLOCK]  = ksyscall_mutex_unlock,
+    [SYSCALL_COND_INIT]     = ksyscall_cond_init,
+    [SYSCALL_COND_WAIT]     = ksyscall_cond_wait,
+    [SYSCALL_COND_SIGNAL]   = ksyscall_cond_signal,
+    [SYSCALL_COND_BROADCAST] = ksyscall_cond_broadcast,
+    [SYSCALL_RWLOCK_INIT]   = ksyscall_rwlock_init,
+    [SYSCALL_RWLOCK_RDLOCK] = ksyscall_rwlock_rdlock,
+    [SYSCALL_RWLOCK_WRLOCK] = ksyscall_rwlock_wrlock,
+    [SYSCALL_RWLOCK_UNLOCK] = ksyscall_rwlock_unlock,
+    [SYSCALL_SEM_TRYWAIT]   = ksyscall_sem_trywait,
+    [SYSCALL_SEM_TIMEDWAIT] = ksyscall_sem_timedwait,
+    [SYSCALL_SEM_DESTROY]   = ksyscall_sem_destroy,
+    [SYSCALL_RING_ATTACH]   = ksyscall_ring_attach,
+    [SYSCALL_SHM_CREATE]    = ksyscall_shm_create,
+    [SYSCALL_SHM_ATTACH]    = ksyscall_shm_attach,
+    [SYSCALL_SHM_DETACH]    = ksyscall_shm_detach,
+    [SYSCALL_TOPIC_SUBSCRIBE] = ksyscall_topic_subscribe,
+    [SYSCALL_TOPIC_UNSUBSCRIBE] = ksyscall_topic_unsubscribe,
+    [SYSCALL_TOPIC_PUBLISH] = ksyscall_topic_publish,
+    [SYSCALL_TOPIC_RECV]    = ksyscall_topic_recv,
+    [SYSCALL_MSG_SEND_PRIO] = ksyscall_msg_send_prio,
+    [SYSCALL_PROC_FORK]     = ksyscall_proc_fork
+};
+
+/**
+ * What the pointer arguments of a system call point to
+ */
+typedef enum {
+    ARG_NONE,                       // Not a pointer
+    ARG_WORD,                       // A single int (sem_t, mutex_t, futex word, ...)
+    ARG_NAME,                       // A process or shared memory segment name
+    ARG_MSG,                        // A msg_t
+    ARG_MBOX_SET,                   // ECX mailbox numbers
+    ARG_MSG_VEC                     // ECX msg_vec_t entries and the messages they point to
+} syscall_arg_t;
+
+/**
+ * Pointer arguments passed in EBX and ECX, indexed by syscall_t
+ */
+static const unsigned char syscall_args[SYSCALL_COUNT][2] = {
+    [SYSCALL_GET_PROC_NAME] = { ARG_NAME },
+    [SYSCALL_SEM_INIT]      = { ARG_WORD },
+    [SYSCALL_SEM_WAIT]      = { ARG_WORD },
+    [SYSCALL_SEM_POST]      = { ARG_WORD },
+    [SYSCALL_MSG_SEND]      = { ARG_MSG },
+    [SYSCALL_MSG_RECV]      = { ARG_MSG },
+    [SYSCALL_MSG_SENDV]     = { ARG_MSG_VEC },
+    [SYSCALL_MSG_RECVV]     = { ARG_MSG_VEC },
+    [SYSCALL_MSG_TRYSEND]   = { ARG_MSG },
+    [SYSCALL_MSG_RECV_TIMEOUT] = { ARG_MSG },
+    [SYSCALL_MSG_TRYRECV]   = { ARG_MSG },
+    [SYSCALL_MSG_SELECT]    = { ARG_MBOX_SET },
+    [SYSCALL_FUTEX_WAIT]    = { ARG_WORD },
+    [SYSCALL_FUTEX_WAKE]    = { ARG_WORD },
+    [SYSCALL_MUTEX_INIT]    = { ARG_WORD },
+    [SYSCALL_MUTEX_LOCK]    = { ARG_WORD },
+    [SYSCALL_MUTEX_UNLOCK]  = { ARG_WORD },
+    [SYSCALL_COND_INIT]     = { ARG_WORD },
+    [SYSCALL_COND_WAIT]     = { ARG_WORD, ARG_WORD },
+    [SYSCALL_COND_SIGNAL]   = { ARG_WORD },
+    [SYSCALL_COND_BROADCAST] = { ARG_WORD },
+    [SYSCALL_RWLOCK_INIT]   = { ARG_WORD },
+    [SYSCALL_RWLOCK_RDLOCK] = { ARG_WORD },
+    [SYSCALL_RWLOCK_WRLOCK] = { ARG_WORD },
+    [SYSCALL_RWLOCK_UNLOCK] = { ARG_WORD },
+    [SYSCALL_SEM_TRYWAIT]   = { ARG_WORD },
+    [SYSCALL_SEM_TIMEDWAIT] = { ARG_WORD },
+    [SYSCALL_SEM_DESTROY]   = { ARG_WORD },
+    [SYSCALL_SHM_CREATE]    = { ARG_NAME },
+    [SYSCALL_SHM_ATTACH]    = { ARG_NAME },
+    [SYSCALL_SHM_DETACH]    = { ARG_NAME },
+    [SYSCALL_TOPIC_PUBLISH] = { ARG_MSG },
+    [SYSCALL_TOPIC_RECV]    = { ARG_MSG }
+};
+
+/**
+ * Checks one pointer argument of a system call
+ * @param  type  - what the argument points to (syscall_arg_t)
+ * @param  addr  - the argument
+ * @param  count - number of entries for ARG_MBOX_SET and ARG_MSG_VEC (ECX)
+ * @return non-zero if the kernel can reach everything it points to
+ */
+static int kisr_syscall_arg_ok(int type, unsigned int addr, int count) {
+
+    int i;
+    msg_vec_t *msg_vec;
+
+    switch (type) {
+        case ARG_WORD:
+            return kvm_user_ok(addr, sizeof(int));
+
+        case ARG_NAME:
+            return kvm_user_ok(addr, PROC_NAME_LEN + 1);
+
+        case ARG_MSG:
+            return kvm_user_ok(addr, sizeof(msg_t));
+
+        case ARG_MBOX_SET:
+            return count <= 0 || kvm_user_ok(addr, count * sizeof(int));
+
+        case ARG_MSG_VEC:
+            if (count <= 0) {
+                return 1;
+            }
+
+            if (!kvm_user_ok(addr, count * sizeof(msg_vec_t))) {
+                return 0;
+            }
+
+            msg_vec = (msg_vec_t *)addr;
+            for (i = 0; i < count; i++) {
+                if (!kvm_user_ok((unsigned int)msg_vec[i].msg, sizeof(msg_t))) {
+                    return 0;
+                }
+            }
+            return 1;
+
+        default:
+            return 1;
+    }
+
+}
+
+/**
+ * Kernel Interrupt Service Routine: System call (int 0x80)
+ * The kernel cannot see the data window, so a call that passes a pointer
+ * into it is refused before it changes any state and the caller is killed.
+ * Buffers of blocked processes are checked when they make the call, so
+ * delivering to them later cannot fault either.
+ */
 void kisr_syscall(){
-	
+
+    unsigned int syscall;
+    trapframe_t *tf;
+
     if(run_pid < 0 || run_pid > PID_MAX)
         panic("Invalid PID");
 
-    //Error here (fixed) - changed from syscall to ksyscall********************************************
-    //Determine the type of system call performed and then call appropriate functions
-    if(pcb[run_pid].trapframe_p -> eax == SYSCALL_GET_PROC_PID)
-        ksyscall_get_proc_pid();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_GET_PROC_NAME)
-        ksyscall_get_proc_name();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_GET_SYS_TIME)
-        ksyscall_get_sys_time();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_PROC_EXIT)
+    // Look up the handler for the system call number in eax
+    syscall = pcb[run_pid]->trapframe_p -> eax;
+    if(syscall >= SYSCALL_COUNT || syscall_table[syscall] == NULL)
+        panic("Invalid syscall");
+
+    tf = pcb[run_pid]->trapframe_p;
+    if (!kisr_syscall_arg_ok(syscall_args[syscall][0], tf->ebx, tf->ecx) ||
+        !kisr_syscall_arg_ok(syscall_args[syscall][1], tf->ecx, 0)) {
+        printf("Process %s (pid=%d) killed: system call %u argument is in the data window\n",
+               pcb[run_pid]->name, run_pid, syscall);
+        kvm_stats.killed++;
         kproc_exit();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_SLEEP)
-        ksyscall_sleep();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_SEM_INIT)
-        ksyscall_sem_init();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_SEM_POST)
-        ksyscall_sem_post();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_SEM_WAIT)
-        ksyscall_sem_wait();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_MSG_RECV)
-        ksyscall_msg_recv();
-    else if(pcb[run_pid].trapframe_p -> eax == SYSCALL_MSG_SEND)
-        ksyscall_msg_send();
-    else
-        panic("Invalid syscall");    
-	
+        return;
+    }
+
+    syscall_table[syscall]();
+
+}
+
+/**
+ * Kernel Interrupt Service Routine: Fast system call (int 0x81)
+ * Serves simple non-blocking system calls directly on the caller's stack,
+ * without saving a trapframe or running the scheduler.
+ * @param  syscall - system call number
+ * @return the system call result, passed back in ebx (low) and ecx (high)
+ */
+unsigned long long kisr_fast(unsigned int syscall) {
+
+    switch (syscall) {
+        case SYSCALL_GET_PROC_PID:
+            return run_pid;
+
+        case SYSCALL_GET_TIME_NS:
+            return ktimer_now_ns();
+
+        default:
+            panic("Invalid fast syscall");
+            break;
+    }
+
+    return 0;
+
 }
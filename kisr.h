@@ -17,6 +17,8 @@
 #define KCODE 0x08                                          // kernel's code segment                         
 #define KDATA 0x10                                          // kernel's data segment
 #define SYSCALL_INTR 0x80                                   // system call interupt
+#define SYSCALL_FAST_INTR 0x81                              // fast (non-blocking) system call interrupt
+#define PAGE_FAULT_INTR 0x0E                                // page fault exception
 
 #ifndef ASSEMBLER
 /**
@@ -25,6 +27,7 @@
 
 void kisr_timer();                                          // Timer ISR
 void kisr_syscall();                                        // Syscall ISR
+unsigned long long kisr_fast(unsigned int syscall);         // Fast syscall ISR
 
 /* Defined in kisr_entry.S */
 __BEGIN_DECLS
@@ -32,6 +35,11 @@ __BEGIN_DECLS
 // Kernel interrupt entries
 extern void kisr_entry_timer();
 extern void syscall_interrupt();
+extern void kisr_entry_fast();
+extern void kisr_entry_page_fault();
+
+// Kernel stack
+extern char kstack[];
 
 __END_DECLS
 #endif
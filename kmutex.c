@@ -0,0 +1,236 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Mutexes
+ *
+ * A mutex has an owner. A process that blocks on a mutex lends its priority
+ * to the owner (and on to whatever the owner is blocked on), so a low
+ * priority owner cannot be starved by the processes it is holding up.
+ */
+#include "spede.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kqueue.h"
+#include "ktimer.h"
+#include "kmutex.h"
+
+/**
+ * Finds the highest priority process waiting on a mutex
+ * Processes with the same priority are taken in FIFO order.
+ * @param  mutex_num - the mutex
+ * @return PID of the waiter, -1 if none
+ */
+static int kmutex_top_waiter(int mutex_num) {
+
+    int pid, top = -1;
+
+    for (pid = mutexes[mutex_num].wait_q.head; pid != -1; pid = pcb[pid]->queue_next) {
+        if (top == -1 || pcb[pid]->priority < pcb[top]->priority) {
+            top = pid;
+        }
+    }
+
+    return top;
+
+}
+
+/**
+ * Raises the priority of a mutex owner, and of the owners it is in turn
+ * blocked on, to at least the given priority. An owner that has exited
+ * has no PCB left to boost.
+ * @param pid       the owner
+ * @param priority  the priority it inherits
+ */
+static void kmutex_boost(int pid, int priority) {
+
+    while (pid != -1 && pcb[pid] != NULL && pcb[pid]->priority > priority) {
+        if (pcb[pid]->base_priority == -1) {
+            pcb[pid]->base_priority = pcb[pid]->priority;
+        }
+        kproc_set_priority(pid, priority);
+
+        pid = pcb[pid]->mutex_wait == -1 ? -1 : mutexes[pcb[pid]->mutex_wait].owner;
+    }
+
+}
+
+/**
+ * Drops the priority a process inherited through mutexes it no longer
+ * holds, keeping what it still inherits through the ones it does
+ * @param pid   the process
+ */
+static void kmutex_restore(int pid) {
+
+    int i, top, priority;
+
+    if (pcb[pid]->base_priority == -1) {
+        return;
+    }
+
+    priority = pcb[pid]->base_priority;
+    for (i = 0; i < MUTEX_MAX; i++) {
+        if (mutexes[i].owner == pid) {
+            top = kmutex_top_waiter(i);
+            if (top != -1 && pcb[top]->priority < priority) {
+                priority = pcb[top]->priority;
+            }
+        }
+    }
+
+    if (priority == pcb[pid]->base_priority) {
+        pcb[pid]->base_priority = -1;
+    }
+    kproc_set_priority(pid, priority);
+
+}
+
+/**
+ * Takes a mutex for a process, queueing the process on it if it is owned
+ * @param  pid       - the process locking the mutex
+ * @param  mutex_num - the mutex
+ * @param  promote   - non-zero to favor the process for blocking
+ * @return 0 if the mutex was taken, -1 if the process blocked
+ */
+static int kmutex_acquire(int pid, int mutex_num, int promote) {
+
+    kmutex_t *mutex = &mutexes[mutex_num];
+
+    if (mutex->owner == -1) {
+        mutex->owner = pid;
+        mutex->lock_time = ktimer_rdtsc();
+        mutex->locks++;
+        return 0;
+    }
+
+    if (mutex->owner == pid) {
+        panic("Mutex is already held by the process");
+    }
+
+    mutex->contended++;
+    pcb[pid]->mutex_wait = mutex_num;
+    pcb[pid]->block_time = ktimer_rdtsc();
+    kqueue_push(&mutex->wait_q, pid);
+
+    pcb[pid]->state = WAITING;
+    if (promote) {
+        kproc_promote(pid);
+    }
+    kmutex_boost(mutex->owner, pcb[pid]->priority);
+
+    return -1;
+
+}
+
+/**
+ * Locks a mutex for a process, blocking the process if it is owned
+ * @param  pid       - the process locking the mutex
+ * @param  mutex_num - the mutex
+ * @return 0 if the mutex was taken, -1 if the process blocked
+ */
+int kmutex_lock(int pid, int mutex_num) {
+
+    return kmutex_acquire(pid, mutex_num, 1);
+
+}
+
+/**
+ * Locks a mutex again for a process that is still blocked, such as a
+ * signaled condition variable waiter. The process was already favored
+ * when it blocked, so it is not promoted a second time.
+ * @param  pid       - the blocked process
+ * @param  mutex_num - the mutex
+ * @return 0 if the mutex was taken, -1 if the process waits for it
+ */
+int kmutex_relock(int pid, int mutex_num) {
+
+    return kmutex_acquire(pid, mutex_num, 0);
+
+}
+
+/**
+ * Unlocks a mutex, handing it straight to the highest priority waiter
+ * @param pid       the process unlocking the mutex (must own it)
+ * @param mutex_num the mutex
+ */
+void kmutex_unlock(int pid, int mutex_num) {
+
+    int next, top;
+    unsigned long long now = ktimer_rdtsc();
+    kmutex_t *mutex = &mutexes[mutex_num];
+
+    if (mutex->owner != pid) {
+        panic("Mutex is not held by the process");
+    }
+
+    mutex->hold_total += now - mutex->lock_time;
+    if (now - mutex->lock_time > mutex->hold_max) {
+        mutex->hold_max = now - mutex->lock_time;
+    }
+
+    next = kmutex_top_waiter(mutex_num);
+    if (next == -1) {
+        mutex->owner = -1;
+        kmutex_restore(pid);
+        return;
+    }
+
+    kqueue_remove(next);
+    mutex->owner = next;
+    mutex->lock_time = now;
+    mutex->locks++;
+    pcb[next]->mutex_wait = -1;
+    if (now - pcb[next]->block_time > mutex->block_max) {
+        mutex->block_max = now - pcb[next]->block_time;
+    }
+
+    kmutex_restore(pid);
+
+    // the new owner inherits from the processes still waiting
+    top = kmutex_top_waiter(mutex_num);
+    if (top != -1) {
+        kmutex_boost(next, pcb[top]->priority);
+    }
+
+    kproc_wake(next);                                               // may preempt the unlocking process
+
+}
+
+/**
+ * Releases the mutexes an exiting process still holds, handing each one to
+ * its next waiter and dropping what the process inherited through it
+ * @param pid   the exiting process (must no longer be run_pid, so a waiter
+ *              that is handed a mutex cannot preempt it onto a run queue)
+ */
+void kmutex_exit(int pid) {
+
+    int i;
+
+    for (i = 0; i < MUTEX_MAX; i++) {
+        if (mutexes[i].owner == pid) {
+            kmutex_unlock(pid, i);
+        }
+    }
+
+}
+
+/**
+ * Displays the hold and blocking times of every mutex that was used
+ */
+void kmutex_print_stats() {
+
+    int i;
+
+    for (i = 0; i < MUTEX_MAX; i++) {
+        if (mutexes[i].locks == 0) {
+            continue;
+        }
+
+        printf("mutex %d: owner=%d locks=%u contended=%u hold avg=%u max=%u us, block max=%u us\n",
+               i, mutexes[i].owner, mutexes[i].locks, mutexes[i].contended,
+               ktimer_cycles_to_us(mutexes[i].hold_total / mutexes[i].locks),
+               ktimer_cycles_to_us(mutexes[i].hold_max), ktimer_cycles_to_us(mutexes[i].block_max));
+    }
+
+}
@@ -0,0 +1,19 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Mutexes
+ */
+#ifndef KMUTEX_H
+#define KMUTEX_H
+
+#include "kernel.h"
+
+int kmutex_lock(int pid, int mutex_num);
+int kmutex_relock(int pid, int mutex_num);
+void kmutex_unlock(int pid, int mutex_num);
+void kmutex_exit(int pid);
+void kmutex_print_stats();
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Page Allocator
+ *
+ * Hands out runs of contiguous pages from kpages[], tracking which pages
+ * are in use with one bit per page.
+ */
+#include "spede.h"
+#include "kernel.h"
+#include "string.h"
+#include "kpage.h"
+
+/**
+ * Checks whether a page is in use
+ * @param  page - page number
+ * @return non-zero if the page is allocated
+ */
+static inline int kpage_used(int page) {
+
+    return kpage_bitmap[page / 32] & (1 << (page % 32));
+
+}
+
+/**
+ * Marks a run of pages as used or free
+ * @param first - first page number
+ * @param count - number of pages
+ * @param used  - non-zero to mark the pages used
+ */
+static void kpage_mark(int first, int count, int used) {
+
+    int page;
+
+    for (page = first; page < first + count; page++) {
+        if (used) {
+            kpage_bitmap[page / 32] |= 1 << (page % 32);
+        } else {
+            kpage_bitmap[page / 32] &= ~(1 << (page % 32));
+        }
+    }
+
+}
+
+/**
+ * Allocates contiguous pages (first fit)
+ * The pages are not cleared.
+ * @param  count - number of pages
+ * @return address of the first page, NULL if no run is large enough
+ */
+void *kpage_alloc(int count) {
+
+    int page, run = 0;
+
+    if (count <= 0) {
+        return NULL;
+    }
+
+    for (page = 0; page < KPAGE_COUNT; page++) {
+        run = kpage_used(page) ? 0 : run + 1;
+
+        if (run == count) {
+            page -= count - 1;
+            kpage_mark(page, count, 1);
+
+            kpage_stats.used += count;
+            if (kpage_stats.used > kpage_stats.peak) {
+                kpage_stats.peak = kpage_stats.used;
+            }
+
+            return kpages[page];
+        }
+    }
+
+    kpage_stats.failed++;
+    return NULL;
+
+}
+
+/**
+ * Returns pages allocated by kpage_alloc
+ * @param addr  - address returned by kpage_alloc
+ * @param count - number of pages that were allocated
+ */
+void kpage_free(void *addr, int count) {
+
+    int first = ((unsigned char *)addr - kpages[0]) / KPAGE_SIZE;
+
+    if ((unsigned char *)addr < kpages[0] || first + count > KPAGE_COUNT ||
+        (unsigned char *)addr != kpages[first]) {
+        panic("Invalid page address");
+    }
+
+    kpage_mark(first, count, 0);
+    kpage_stats.used -= count;
+
+}
+
+/**
+ * Displays page allocator usage on the host console
+ */
+void kpage_print_stats() {
+
+    printf("pages: used=%d peak=%d free=%d failed=%d (%d bytes each)\n",
+           kpage_stats.used, kpage_stats.peak, KPAGE_COUNT - kpage_stats.used,
+           kpage_stats.failed, KPAGE_SIZE);
+
+}
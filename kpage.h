@@ -0,0 +1,17 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Page Allocator
+ */
+#ifndef KPAGE_H
+#define KPAGE_H
+
+#include "kernel.h"
+
+void *kpage_alloc(int count);
+void kpage_free(void *addr, int count);
+void kpage_print_stats();
+
+#endif
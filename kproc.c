@@ -8,88 +8,446 @@
 #include "spede.h"
 #include "kernel.h"
 #include "kproc.h"
+#include "kpage.h"
+#include "kslab.h"
+#include "kqueue.h"
+#include "ksyscall.h"
+#include "ktopic.h"
+#include "ktimer.h"
+#include "kmutex.h"
+#include "kvm.h"
 #include "queue.h"
 #include "string.h"
+#include "vdso.h"
+
+/**
+ * Returns the highest priority level that has a process ready to run
+ * @param  bitmap - bitmap of non-empty priority levels (must be non-zero)
+ * @return index of the lowest set bit
+ */
+static inline int prio_first(unsigned int bitmap) {
+
+    int prio;
+
+    asm("bsfl %1, %0" : "=r"(prio) : "rm"(bitmap));               // Bit scan forward finds the lowest set bit in one instruction
+    return prio;
+
+}
+
+/**
+ * Makes a process the running process
+ * @param pid   the process to run
+ */
+static void kproc_dispatch(int pid) {
+
+    if (pid < 0 || pid > PID_MAX) {
+        panic("Invalid PID");                                       // invalid process or PID
+    }
+
+    run_pid = pid;
+    pcb[run_pid]->state = RUNNING;
+    vdso_update_proc();                                             // Publish the new running process
+
+    // Record wakeup-to-run latency if the process was just woken up
+    if (pcb[run_pid]->ready_time >= 0) {
+        int latency = (int)(system_time - pcb[run_pid]->ready_time);
+
+        sched_stats.wakeups++;
+        sched_stats.latency_total += latency;
+        if (latency > sched_stats.latency_max) {
+            sched_stats.latency_max = latency;
+        }
+        pcb[run_pid]->ready_time = -1;
+    }
+
+}
 
 //Process scheduler
 void kproc_schedule() {
 
+    int prio;
+    unsigned int cycles;
+
     //If active process, return
     if (run_pid >= 0) {
         return;
     }
 
-    if (dequeue(&run_q, &run_pid) == 0) {                           // Retrieve a process from the run queue
-        pcb[run_pid].state = RUNNING;
-    } 
-	else if(dequeue(&idle_q, &run_pid) == 0){                       // Retrieve a process from the idle queue
-		pcb[run_pid].state = RUNNING;
-	}
-	else {
+    cycles = ktimer_cycles();
+
+    if (prio_bitmap == 0) {
         panic("No tasks scheduled to run");                         // no process to run
     }
 
-    if (run_pid < 0 || run_pid > PID_MAX) {
-        panic("Invalid PID");                                       // invalid process or PID
+    prio = prio_first(prio_bitmap);                                 // Pick the highest non-empty priority level
+    if (kqueue_pop(&prio_q[prio], &run_pid) != 0) {
+        panic("Priority bitmap out of sync with run queues");
+    }
+    if (prio_q[prio].size == 0) {
+        prio_bitmap &= ~(1 << prio);                                // Level is now empty
+    }
+
+    kproc_dispatch(run_pid);
+
+    // Record the cost of the pick, which should not grow with the number of ready processes
+    cycles = ktimer_cycles() - cycles;
+    sched_stats.picks++;
+    sched_stats.pick_cycles += cycles;
+    if (cycles > sched_stats.pick_cycles_max) {
+        sched_stats.pick_cycles_max = cycles;
+    }
+
+}
+
+/**
+ * Adds a process to the tail of the run queue for its priority level
+ * @param pid   the process to add
+ */
+static void kproc_enqueue(int pid) {
+
+    int prio = pcb[pid]->priority;
+
+    pcb[pid]->state = READY;
+    kqueue_push(&prio_q[prio], pid);                                // The process now belongs to its level's run queue
+    prio_bitmap |= 1 << prio;
+
+}
+
+/**
+ * Makes a process ready to run. If it has a higher priority than the
+ * running process, the running process is preempted.
+ * @param pid   the process to make ready
+ */
+void kproc_ready(int pid) {
+
+    if (pid < 0 || pid > PID_MAX) {
+        panic("Invalid PID");
+    }
+
+    kproc_enqueue(pid);
+
+    // Preempt the running process so the scheduler picks the new one
+    if (run_pid >= 0 && run_pid != pid && pcb[pid]->priority < pcb[run_pid]->priority) {
+        kproc_enqueue(run_pid);
+        run_pid = -1;
+    }
+
+}
+
+/**
+ * Makes a blocked process ready to run and starts timing how long it
+ * waits until it is dispatched
+ * @param pid   the process to wake up
+ */
+void kproc_wake(int pid) {
+
+    pcb[pid]->ready_time = system_time;
+    kproc_ready(pid);
+
+}
+
+/**
+ * Wakes up a blocked process and runs it right away in place of the
+ * running process, which goes back to its run queue
+ * @param pid   the process to hand the CPU to
+ */
+void kproc_handoff(int pid) {
+
+    pcb[pid]->ready_time = system_time;
+
+    if (run_pid >= 0) {
+        kproc_enqueue(run_pid);
+    }
+
+    kproc_dispatch(pid);
+
+}
+
+/**
+ * Raises the priority of a process that is about to block
+ * @param pid   the process to promote
+ */
+void kproc_promote(int pid) {
+
+    int *priority = pcb[pid]->base_priority == -1 ? &pcb[pid]->priority : &pcb[pid]->base_priority;
+
+    pcb[pid]->total_time += pcb[pid]->time;                         // Start a fresh time slice when it wakes
+    pcb[pid]->time = 0;
+
+    if (*priority > PRIO_HIGH && *priority != PRIO_IDLE) {
+        (*priority)--;
+    }
+
+    if (*priority < pcb[pid]->priority) {                           // Promoted past the inherited priority
+        pcb[pid]->priority = *priority;
+        pcb[pid]->base_priority = -1;
+    }
+
+}
+
+/**
+ * Lowers the priority of a process that used up its time slice
+ * @param pid   the process to demote
+ */
+void kproc_demote(int pid) {
+
+    // An inherited priority is kept until the mutex is unlocked
+    int *priority = pcb[pid]->base_priority == -1 ? &pcb[pid]->priority : &pcb[pid]->base_priority;
+
+    if (*priority < PRIO_LOW) {
+        (*priority)++;
+    }
+
+}
+
+/**
+ * Changes the priority of a process, moving it to the matching run queue
+ * if it is ready to run
+ * @param pid       the process
+ * @param priority  its new priority level
+ */
+void kproc_set_priority(int pid, int priority) {
+
+    if (pcb[pid]->state != READY) {
+        pcb[pid]->priority = priority;
+        return;
     }
 
+    if (kqueue_remove(pid) != 0) {
+        panic("Ready process is not on its run queue");
+    }
+    if (prio_q[pcb[pid]->priority].size == 0) {
+        prio_bitmap &= ~(1 << pcb[pid]->priority);                  // Level is now empty
+    }
+
+    pcb[pid]->priority = priority;
+    kproc_enqueue(pid);
+
+}
+
+/**
+ * Displays the scheduler statistics on the host console
+ */
+void kproc_print_stats() {
+
+    int prio;
+
+    printf("sched: wakeups=%d latency avg=%d max=%d ticks\n", sched_stats.wakeups,
+           sched_stats.wakeups ? sched_stats.latency_total / sched_stats.wakeups : 0,
+           sched_stats.latency_max);
+    printf("sched: picks=%u cost avg=%u max=%u cycles\n", sched_stats.picks,
+           sched_stats.picks ? (unsigned int)(sched_stats.pick_cycles / sched_stats.picks) : 0,
+           sched_stats.pick_cycles_max);
+
+    for (prio = 0; prio < PRIO_LEVELS; prio++) {
+        printf("sched: level %d ready=%d slice=%d\n", prio, prio_q[prio].size, PRIO_TICKS(prio));
+    }
+
+}
+
+/**
+ * Picks the process ID for a new process. IDs are handed out in turn, so
+ * an ID that was just released is not reused until the rest have come up.
+ * With at most PROC_MAX of the PID_MAX+1 IDs in use, a free one is found
+ * after a short scan.
+ * @return process ID, -1 if PROC_MAX processes exist
+ */
+static int kproc_alloc_pid() {
+
+    int i, pid;
+
+    if (pcb_cache.live >= PROC_MAX) {
+        return -1;
+    }
+
+    for (i = 0; i <= PID_MAX; i++) {
+        pid = (pid_next + i) % (PID_MAX + 1);
+        if (pcb[pid] == NULL) {
+            pid_next = (pid + 1) % (PID_MAX + 1);
+            return pid;
+        }
+    }
+
+    return -1;
+
 }
 
 /**
  * Start a new process
  * @param proc_name The process title
  * @param proc_ptr  function pointer for the process
- * @param queue     the run queue in which this process belongs
+ * @param priority  the priority level the process starts at
+ * @return the new process ID; -1 if no process is available
+ */
+int kproc_exec(char *proc_name, void *proc_ptr, int priority) {
+
+    return kproc_exec_stack(proc_name, proc_ptr, priority, PROC_STACK_SIZE);
+
+}
+
+/**
+ * Releases the mutexes, shared memory segments, topic subscriptions,
+ * address space, stack and PCB of a process
+ * @param pid - process ID
+ */
+static void kproc_free(int pid) {
+
+    kmutex_exit(pid);
+    shm_exit(pid);
+    ktopic_exit(pid);
+    kvm_destroy(pid);
+    kpage_free(pcb[pid]->stack, pcb[pid]->stack_pages);
+    kslab_free(&pcb_cache, pcb[pid]);
+    pcb[pid] = NULL;
+
+}
+
+/**
+ * Creates a new process without making it ready to run
+ * @param  proc_name  - name of the process
+ * @param  proc_ptr   - pointer to the function that the process will run
+ * @param  priority   - scheduling priority level to start at
+ * @param  stack_size - size of the runtime stack, rounded up to whole pages
+ * @return process id of the created process, -1 on error
  */
-void kproc_exec(char *proc_name, void *proc_ptr, queue_t *queue) {
+static int kproc_create(char *proc_name, void *proc_ptr, int priority, int stack_size) {
 
     int pid;
+    int pages;
+    unsigned char *stack;
     // Ensure that valid parameters have been specified
     if (proc_name == NULL) 
         panic("Invalid process title");
     if (proc_ptr == NULL) 
         panic("Invalid function pointer");
-    if (queue == NULL) 
-        panic("Invalid queue specified");
+    if (priority < PRIO_HIGH || priority > PRIO_IDLE) 
+        panic("Invalid priority specified");
+    if (stack_size < (int)sizeof(trapframe_t))
+        panic("Invalid stack size specified");
 
-    // Dequeue the process from the available queue
-    if (dequeue(&available_q, &pid) != 0) {
-        panic_warn("Unable to retrieve process from available queue");
-        return;
+    // Pick the process ID
+    if ((pid = kproc_alloc_pid()) < 0) {
+        panic_warn("Unable to allocate a process ID");
+        return -1;
+    }
+
+    // Allocate the runtime stack
+    pages = (stack_size + KPAGE_SIZE - 1) / KPAGE_SIZE;
+    stack = kpage_alloc(pages);
+    if (stack == NULL) {
+        panic_warn("Unable to allocate a process stack");
+        return -1;
     }
 
-    sp_memset(&pcb[pid], 0, sizeof(pcb_t));                                 // Initialize the PCB
+    // Create the PCB
+    pcb[pid] = kslab_alloc(&pcb_cache);
+    if (pcb[pid] == NULL) {
+        kpage_free(stack, pages);
+        panic_warn("Unable to allocate a process control block");
+        return -1;
+    }
+
+    sp_memset(pcb[pid], 0, sizeof(pcb_t));                                  // Initialize the PCB
+
+    pcb[pid]->state = READY;                                                // Set the process state to READY
+    pcb[pid]->time = 0;                                                     // initializing other values to default values
+    pcb[pid]->total_time = 0;
+    pcb[pid]->priority = priority;
+    pcb[pid]->ready_time = -1;
+    pcb[pid]->queue = NULL;                                                 // not on a run or wait queue
+    pcb[pid]->sleep_prev = -1;                                              // not on the sleep list
+    pcb[pid]->sleep_next = -1;
+    pcb[pid]->base_priority = -1;                                           // not inheriting a priority
+    pcb[pid]->mutex_wait = -1;
 
-    pcb[pid].state = READY;                                                 // Set the process state to READY
-    pcb[pid].time = 0;                                                      // initializing other values to default values
-    pcb[pid].total_time = 0;
+    pcb[pid]->stack = stack;
+    pcb[pid]->stack_pages = pages;
 
-    sp_strncpy(pcb[pid].name, proc_name, PROC_NAME_LEN);                    // Copy the process name to the PCB
-    sp_memset(stack[pid], 0, sizeof(stack[pid]));                           // Ensure the stack for the process is cleared
+    sp_strncpy(pcb[pid]->name, proc_name, PROC_NAME_LEN);                   // Copy the process name to the PCB
 
-    // Allocate the trapframe data
-    pcb[pid].trapframe_p = (trapframe_t *)&stack[pid][PROC_STACK_SIZE - sizeof(trapframe_t)];
+    // Allocate the trapframe data at the top of the stack; only it needs clearing
+    pcb[pid]->trapframe_p = (trapframe_t *)&stack[pages * KPAGE_SIZE - sizeof(trapframe_t)];
+    sp_memset(pcb[pid]->trapframe_p, 0, sizeof(trapframe_t));
 
     // Set the instruction pointer in the trapframe
-    pcb[pid].trapframe_p->eip = (unsigned int)proc_ptr;
+    pcb[pid]->trapframe_p->eip = (unsigned int)proc_ptr;
 
     // Set INTR flag
-    pcb[pid].trapframe_p->eflags = EF_DEFAULT_VALUE | EF_INTR;
+    pcb[pid]->trapframe_p->eflags = EF_DEFAULT_VALUE | EF_INTR;
 
     // Set each segment in the trapframe
-    pcb[pid].trapframe_p->cs = get_cs();
-    pcb[pid].trapframe_p->ds = get_ds();
-    pcb[pid].trapframe_p->es = get_es();
-    pcb[pid].trapframe_p->fs = get_fs();
-    pcb[pid].trapframe_p->gs = get_gs();
+    pcb[pid]->trapframe_p->cs = get_cs();
+    pcb[pid]->trapframe_p->ds = get_ds();
+    pcb[pid]->trapframe_p->es = get_es();
+    pcb[pid]->trapframe_p->fs = get_fs();
+    pcb[pid]->trapframe_p->gs = get_gs();
+
+    // Give the process its own address space
+    if (kvm_create(pid) != 0) {
+        kproc_free(pid);
+        panic_warn("Unable to allocate a page directory");
+        return -1;
+    }
 
-    // Set the process run queue
-    pcb[pid].queue = queue;
+    return pid;
 
-    // Move the proces into the associated run queue
-    enqueue(pcb[pid].queue, pid);
+}
 
-    printf("Started process %s (pid=%d)\n", pcb[pid].name, pid);
+/**
+ * Creates a new process with a runtime stack of the given size
+ * @param  proc_name  - name of the process
+ * @param  proc_ptr   - pointer to the function that the process will run
+ * @param  priority   - scheduling priority level to start at
+ * @param  stack_size - size of the runtime stack, rounded up to whole pages
+ * @return process id of the created process, -1 on error
+ */
+int kproc_exec_stack(char *proc_name, void *proc_ptr, int priority, int stack_size) {
+
+    int pid = kproc_create(proc_name, proc_ptr, priority, stack_size);
+
+    if (pid < 0) {
+        return -1;
+    }
+
+    // Move the proces into the run queue for its priority level
+    kproc_ready(pid);
+
+    printf("Started process %s (pid=%d)\n", pcb[pid]->name, pid);
+
+    return pid;
+
+}
+
+/**
+ * Starts a worker for the running process
+ * The worker gets its own stack and starts at proc_ptr, but shares the
+ * data window of the running process copy-on-write, so only the page
+ * table is copied.
+ * @param  proc_ptr - pointer to the function that the worker will run
+ * @return process id of the worker, -1 on error
+ */
+int kproc_fork(void *proc_ptr) {
+
+    int parent = run_pid;
+    int priority, pid;
+
+    // Start at the parent's own level, not one it inherited through a mutex
+    priority = pcb[parent]->base_priority == -1 ? pcb[parent]->priority : pcb[parent]->base_priority;
+
+    pid = kproc_create(pcb[parent]->name, proc_ptr, priority, pcb[parent]->stack_pages * KPAGE_SIZE);
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (kvm_fork(parent, pid) != 0) {
+        kproc_free(pid);
+        panic_warn("Unable to share the data window");
+        return -1;
+    }
+
+    kproc_ready(pid);
+
+    return pid;
 
 }
 
@@ -98,6 +456,8 @@ void kproc_exec(char *proc_name, void *proc_ptr, queue_t *queue) {
  */
 void kproc_exit() {
 
+    int pid;
+
     //printf("\n\nInside kproc_exit() function\n\n");
     // if idle task, don't exit
     //printf("RUN_PID in exit function is: %d    and     PID in exit function is: %d \n\n\n", run_pid, pid);
@@ -113,13 +473,13 @@ void kproc_exit() {
     }
 
     //printf("Right before print statements \n\n");
-    //cons_printf("Exiting process %s (pid=%d)\n", pcb[run_pid].name, run_pid);
-    printf("Exiting process %s (pid=%d)\n", pcb[run_pid].name, run_pid);
+    //cons_printf("Exiting process %s (pid=%d)\n", pcb[run_pid]->name, run_pid);
+    printf("Exiting process %s (pid=%d)\n", pcb[run_pid]->name, run_pid);
     cons_printf("Process Exited\n");                                // Indicate that the process has exited, on the target
     
-    pcb[run_pid].state = AVAILABLE;                                 // Change the state of the running process to AVAILABLE
-    enqueue(&available_q, run_pid);                                 // Queue it back to the available queue
-    run_pid = -1;                                                   // clear the running pid
+    pid = run_pid;
+    run_pid = -1;                                                   // clear the running pid (first, so a woken mutex waiter cannot preempt it)
+    kproc_free(pid);                                                // We are on the kernel stack and address space, so all of it can go
     kproc_schedule();                                               // Trigger the scheduler to load the next process
 
 }
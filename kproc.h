@@ -15,9 +15,20 @@
 // Kernel process functions
 void kproc_schedule();
 void kproc_load(trapframe_t *trapframe);
-void kproc_exec(char *proc_name, void *func_ptr, queue_t *queue);
+int kproc_exec(char *proc_name, void *func_ptr, int priority);
+int kproc_exec_stack(char *proc_name, void *func_ptr, int priority, int stack_size);
+int kproc_fork(void *func_ptr);
 void kproc_exit();
 
+// Scheduler queue management
+void kproc_ready(int pid);
+void kproc_wake(int pid);
+void kproc_handoff(int pid);
+void kproc_promote(int pid);
+void kproc_demote(int pid);
+void kproc_set_priority(int pid, int priority);
+void kproc_print_stats();
+
 // Kernel tasks
 void ktask_idle();
 
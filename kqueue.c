@@ -0,0 +1,138 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Process Queues
+ *
+ * Run queues and wait queues are doubly linked lists threaded through the
+ * PCBs (queue_prev/queue_next), so they hold any number of processes and
+ * a process can be taken off its queue in constant time. A process is on
+ * at most one of these queues at a time; pcb_t.queue names it.
+ *
+ * Mailbox select queues are kqueue_t lists too, but a selecting process
+ * waits on several mailboxes at once, so they are linked through the
+ * per-mailbox select_prev/select_next nodes instead (see ksyscall.c).
+ * No wait queue is bounded by QUEUE_SIZE any more.
+ */
+#include "spede.h"
+#include "kernel.h"
+#include "kqueue.h"
+
+/**
+ * Empties a process queue
+ * @param queue - the queue
+ */
+void kqueue_init(kqueue_t *queue) {
+
+    queue->head = -1;
+    queue->tail = -1;
+    queue->size = 0;
+
+}
+
+/**
+ * Adds a process to the tail of a queue
+ * @param queue - the queue
+ * @param pid   - the process, which must not be on a queue
+ */
+void kqueue_push(kqueue_t *queue, int pid) {
+
+    if (pcb[pid]->queue != NULL) {
+        panic("Process is already on a queue");
+    }
+
+    pcb[pid]->queue = queue;
+    pcb[pid]->queue_prev = queue->tail;
+    pcb[pid]->queue_next = -1;
+
+    if (queue->tail != -1) {
+        pcb[queue->tail]->queue_next = pid;
+    } else {
+        queue->head = pid;
+    }
+    queue->tail = pid;
+    queue->size++;
+
+}
+
+/**
+ * Adds a process to a queue in front of another one
+ * @param queue - the queue
+ * @param pid   - the process, which must not be on a queue
+ * @param next  - process on the queue to insert in front of, -1 for the tail
+ */
+void kqueue_insert(kqueue_t *queue, int pid, int next) {
+
+    if (next == -1) {
+        kqueue_push(queue, pid);
+        return;
+    }
+
+    if (pcb[pid]->queue != NULL) {
+        panic("Process is already on a queue");
+    }
+
+    pcb[pid]->queue = queue;
+    pcb[pid]->queue_prev = pcb[next]->queue_prev;
+    pcb[pid]->queue_next = next;
+
+    if (pcb[next]->queue_prev != -1) {
+        pcb[pcb[next]->queue_prev]->queue_next = pid;
+    } else {
+        queue->head = pid;
+    }
+    pcb[next]->queue_prev = pid;
+    queue->size++;
+
+}
+
+/**
+ * Takes the process at the head of a queue
+ * @param  queue - the queue
+ * @param  pid   - set to the process taken
+ * @return -1 if the queue is empty; 0 on success
+ */
+int kqueue_pop(kqueue_t *queue, int *pid) {
+
+    if (queue->head == -1) {
+        return -1;
+    }
+
+    *pid = queue->head;
+    return kqueue_remove(*pid);
+
+}
+
+/**
+ * Takes a process off whatever queue it is on
+ * @param  pid - the process
+ * @return -1 if the process is not on a queue; 0 on success
+ */
+int kqueue_remove(int pid) {
+
+    kqueue_t *queue = pcb[pid]->queue;
+    int prev = pcb[pid]->queue_prev;
+    int next = pcb[pid]->queue_next;
+
+    if (queue == NULL) {
+        return -1;
+    }
+
+    if (prev != -1) {
+        pcb[prev]->queue_next = next;
+    } else {
+        queue->head = next;
+    }
+
+    if (next != -1) {
+        pcb[next]->queue_prev = prev;
+    } else {
+        queue->tail = prev;
+    }
+
+    queue->size--;
+    pcb[pid]->queue = NULL;
+    return 0;
+
+}
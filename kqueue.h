@@ -0,0 +1,19 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Process Queues
+ */
+#ifndef KQUEUE_H
+#define KQUEUE_H
+
+#include "kernel.h"
+
+void kqueue_init(kqueue_t *queue);
+void kqueue_push(kqueue_t *queue, int pid);
+void kqueue_insert(kqueue_t *queue, int pid, int next);
+int kqueue_pop(kqueue_t *queue, int *pid);
+int kqueue_remove(int pid);
+
+#endif
@@ -0,0 +1,149 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Object Caches
+ *
+ * Each cache hands out objects of one type. Slabs of pages are taken from
+ * the page allocator when the cache runs dry and cut into objects, which
+ * are kept on a free list threaded through the free objects themselves.
+ * Objects are not cleared or constructed; the caller initializes them.
+ */
+#include "spede.h"
+#include "kernel.h"
+#include "kpage.h"
+#include "kslab.h"
+
+/**
+ * Sets up an empty cache
+ * @param cache       - the cache
+ * @param name        - name shown in the statistics
+ * @param obj_size    - size of one object
+ * @param table_count - objects the static table replaced by the cache held
+ */
+void kslab_init(kslab_t *cache, char *name, int obj_size, int table_count) {
+
+    int waste;
+
+    if (obj_size <= 0 || obj_size > KSLAB_PAGES_MAX * KPAGE_SIZE) {
+        panic("Invalid object size");
+    }
+
+    cache->name = name;
+    cache->obj_size = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    cache->free = NULL;
+    cache->slabs = 0;
+    cache->live = 0;
+    cache->peak = 0;
+    cache->failed = 0;
+    cache->table_count = table_count;
+
+    // Use the smallest slab that wastes at most an eighth of its space
+    for (cache->slab_pages = 1; cache->slab_pages < KSLAB_PAGES_MAX; cache->slab_pages++) {
+        waste = (cache->slab_pages * KPAGE_SIZE) % cache->obj_size;
+        if (waste * 8 <= cache->slab_pages * KPAGE_SIZE) {
+            break;
+        }
+    }
+    cache->per_slab = cache->slab_pages * KPAGE_SIZE / cache->obj_size;
+
+}
+
+/**
+ * Adds a slab of free objects to a cache
+ * @param  cache - the cache
+ * @return 0 on success, -1 if the page allocator is out of pages
+ */
+static int kslab_grow(kslab_t *cache) {
+
+    int i;
+    unsigned char *slab = kpage_alloc(cache->slab_pages);
+
+    if (slab == NULL) {
+        return -1;
+    }
+
+    // Push the objects in reverse so they are handed out in address order
+    for (i = cache->per_slab - 1; i >= 0; i--) {
+        *(void **)&slab[i * cache->obj_size] = cache->free;
+        cache->free = &slab[i * cache->obj_size];
+    }
+
+    cache->slabs++;
+    return 0;
+
+}
+
+/**
+ * Takes an object from a cache
+ * @param  cache - the cache
+ * @return the object (not cleared), NULL if no memory is left
+ */
+void *kslab_alloc(kslab_t *cache) {
+
+    void *obj;
+
+    if (cache->free == NULL && kslab_grow(cache) != 0) {
+        cache->failed++;
+        return NULL;
+    }
+
+    obj = cache->free;
+    cache->free = *(void **)obj;
+
+    cache->live++;
+    if (cache->live > cache->peak) {
+        cache->peak = cache->live;
+    }
+
+    return obj;
+
+}
+
+/**
+ * Returns an object to its cache
+ * Slabs are kept by the cache for later allocations.
+ * @param cache - the cache
+ * @param obj   - object returned by kslab_alloc
+ */
+void kslab_free(kslab_t *cache, void *obj) {
+
+    if (obj == NULL) {
+        panic("Invalid object");
+    }
+
+    *(void **)obj = cache->free;
+    cache->free = obj;
+    cache->live--;
+
+}
+
+/**
+ * Displays one cache on the host console
+ * @param cache - the cache
+ */
+static void kslab_print_cache(kslab_t *cache) {
+
+    int table = cache->table_count * cache->obj_size;
+    int used = cache->slabs * cache->slab_pages * KPAGE_SIZE;
+
+    printf("  %s: live=%d peak=%d slabs=%d (%d pages, %d objects of %d bytes) failed=%d saved=%d bytes\n",
+           cache->name, cache->live, cache->peak, cache->slabs, cache->slab_pages,
+           cache->per_slab, cache->obj_size, cache->failed, table - used);
+
+}
+
+/**
+ * Displays usage of the kernel object caches on the host console
+ * Bytes saved compare the slabs in use with the static tables the caches
+ * replaced.
+ */
+void kslab_print_stats() {
+
+    printf("object caches:\n");
+    kslab_print_cache(&pcb_cache);
+    kslab_print_cache(&sem_cache);
+    kslab_print_cache(&mbox_cache);
+
+}
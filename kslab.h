@@ -0,0 +1,18 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Object Caches
+ */
+#ifndef KSLAB_H
+#define KSLAB_H
+
+#include "kernel.h"
+
+void kslab_init(kslab_t *cache, char *name, int obj_size, int table_count);
+void *kslab_alloc(kslab_t *cache);
+void kslab_free(kslab_t *cache, void *obj);
+void kslab_print_stats();
+
+#endif
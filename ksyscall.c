@@ -12,23 +12,54 @@
 #include "queue.h"
 #include "ksyscall.h"
 #include "ipc.h"
+#include "ktimer.h"
+#include "kmutex.h"
+#include "kpage.h"
+#include "kslab.h"
+#include "kvm.h"
+#include "kqueue.h"
+#include "ktopic.h"
 
 // Foward Declarations
-int mbox_enqueue(msg_t *msg, int mbox_num);
+int mbox_enqueue(msg_t *msg, int len, int mbox_num, int sender, int prio);
 int mbox_dequeue(msg_t *msg, int mbox_num);
+int mbox_dequeuev(msg_vec_t *msg_vec, int max, int mbox_num);
+static mailbox_t *mbox_get(int mbox_num);
+static void mbox_send(int block);
+static int mbox_prio(trapframe_t *tf);
+static void mbox_record_delay(int prio, unsigned int cycles);
+static void mbox_ring_remove(mailbox_t *mb, int off, int n);
+static void mbox_recv(int timeout_ms);
+static void mbox_sendv_some(int pid, int mbox_num, kqueue_t *woken);
+static void mbox_deliver_waiting(int mbox_num, kqueue_t *woken);
+static void mbox_wake_list(kqueue_t *woken);
+static void mbox_wake_senders(int mbox_num);
+static void mbox_wake_receivers(int mbox_num);
+static void mbox_wake_selector(int mbox_num);
+static void shm_release(int shm_num, int refs);
+static void mbox_select_add(int mbox_num, int pid);
+static void mbox_select_cancel(int pid);
+static void kblock(kqueue_t *queue);
+static int ksem_get();
+static void ksem_wait(int timeout_ms);
+static void ksem_timeout(int pid);
 
 /**
- * System call kernel handler: get_sys_time
- * Returns the current system time (in seconds)
+ * System call kernel handler: get_time_ns
+ * Returns the time since boot (in nanoseconds) from the time stamp counter
  */
-void ksyscall_get_sys_time() {
-    
+void ksyscall_get_time_ns() {
+
+    unsigned long long ns;
+
     // Don't do anything if the running PID is invalid
     if(run_pid < 0 || run_pid > PID_MAX)
         panic("Invalid PID");
 
-    // Copy the system time from the kernel to the eax register via the running process' trapframe
-    pcb[run_pid].trapframe_p -> ebx = system_time / CLK_TCK;        //Taken from demo code
+    // Copy the 64-bit time to the ebx (low) and ecx (high) registers via the running process' trapframe
+    ns = ktimer_now_ns();
+    pcb[run_pid]->trapframe_p -> ebx = (unsigned int)ns;
+    pcb[run_pid]->trapframe_p -> ecx = (unsigned int)(ns >> 32);
 
 }
 
@@ -44,7 +75,7 @@ void ksyscall_get_proc_pid() {
     }
 
     // Copy the running pid from the kernel to the ebx register via the running process' trapframe
-    pcb[run_pid].trapframe_p->ebx = run_pid;
+    pcb[run_pid]->trapframe_p->ebx = run_pid;
 
 }
 
@@ -59,35 +90,77 @@ void ksyscall_get_proc_name() {
         panic("Invalid PID");
 
     // Set the destination pointer to the address passed in via EBX Copy the string name from the PCB to the destination
-    sp_strcpy((char *)pcb[run_pid].trapframe_p->ebx, pcb[run_pid].name);
+    sp_strcpy((char *)pcb[run_pid]->trapframe_p->ebx, pcb[run_pid]->name);
 
 }
 
 /**
- * System call kernel handler: sleep
- * Puts the currently running process to sleep
+ * System call kernel handler: proc_fork
+ * Starts a worker running the function passed in via EBX that shares the
+ * caller's data window copy-on-write; its PID (-1 on error) is returned in EBX
  */
-void ksyscall_sleep() {
+void ksyscall_proc_fork() {
+
+    int pid = run_pid;
 
     // Don't do anything if the running PID is invalid
     if(run_pid < 0 || run_pid > PID_MAX)
         panic("Invalid PID");
 
-    // Calculate the wake time for the currently running process and store it in pcb's wakeTime member
-    pcb[run_pid].wake_time = system_time + CLK_TCK * pcb[run_pid].trapframe_p->ebx;
+    pcb[pid]->trapframe_p->ebx = kproc_fork((void *)pcb[pid]->trapframe_p->ebx);
+
+}
+
+/**
+ * Puts the currently running process to sleep
+ * @param ticks number of timer ticks to sleep for
+ */
+static void ksleep(tick_t ticks) {
+
+    // Don't do anything if the running PID is invalid
+    if(run_pid < 0 || run_pid > PID_MAX)
+        panic("Invalid PID");
 
-    // Move the currently running process to the sleep queue
-    //pcb[run_pid].queue = &sleep_q;
-    enqueue(&sleep_q, run_pid);
+    // Calculate the wake time for the currently running process and add it to the sleep list
+    ktimer_add(run_pid, system_time + ticks);
 
     // Change the running process state to SLEEP
-    pcb[run_pid].state = SLEEPING;
+    pcb[run_pid]->state = SLEEPING;
+    kproc_promote(run_pid);                                         // Processes that block are favored when they wake
 
     // Clear the running PID so the process scheduler will run
     run_pid = -1;
 
 }
 
+/**
+ * System call kernel handler: sleep_ms
+ * Puts the currently running process to sleep for EBX milliseconds,
+ * rounded up to whole timer ticks
+ */
+void ksyscall_sleep_ms() {
+
+    if(run_pid < 0 || run_pid > PID_MAX)
+        panic("Invalid PID");
+
+    ksleep(ktimer_ms_to_ticks(pcb[run_pid]->trapframe_p->ebx));
+
+}
+
+/**
+ * System call kernel handler: sleep_us
+ * Puts the currently running process to sleep for EBX microseconds,
+ * rounded up to whole timer ticks
+ */
+void ksyscall_sleep_us() {
+
+    if(run_pid < 0 || run_pid > PID_MAX)
+        panic("Invalid PID");
+
+    ksleep(((tick_t)pcb[run_pid]->trapframe_p->ebx * CLK_TCK + 999999) / 1000000);
+
+}
+
 // Function to initialize the semaphores
 void ksyscall_sem_init()
 {
@@ -100,12 +173,12 @@ void ksyscall_sem_init()
 	}
 	
 	// obtain the passed semaphore_id fromt he trapframe
-	sem_ptr = (int *)pcb[run_pid].trapframe_p->ebx;
+	sem_ptr = (int *)pcb[run_pid]->trapframe_p->ebx;
 
 	// If the call to sem_init is on initialized semaphore, then ensure that count is initialized to 0
-	if(*sem_ptr != SEMAPHORE_UNINITIALIZED && semaphores[*sem_ptr].init == SEMAPHORE_INITIALIZED){
+	if(*sem_ptr >= 0 && *sem_ptr < SEMAPHORE_MAX && semaphores[*sem_ptr] != NULL){
 
-		semaphores[*sem_ptr].count = 0;
+		semaphores[*sem_ptr]->count = 0;
 
 	}
 	else if (*sem_ptr == SEMAPHORE_UNINITIALIZED)
@@ -114,264 +187,1634 @@ void ksyscall_sem_init()
 		{
 			panic("Invalid Semaphore");
 		}
+
+		// the semaphore itself is created from its object cache
+		semaphores[sem_num] = kslab_alloc(&sem_cache);
+		if (semaphores[sem_num] == NULL)
+		{
+			panic("Out of memory for semaphores");
+		}
+		kqueue_init(&semaphores[sem_num]->wait_q);
+		semaphores[sem_num]->count = 0;
 		*sem_ptr = sem_num;
-		semaphores[*sem_ptr].count = 0;
-		semaphores[*sem_ptr].init = SEMAPHORE_INITIALIZED;
 	}
 
 }
 
 // Function to tell the semaphore to wait
 void ksyscall_sem_wait()
+{
+	ksem_wait(-1);
+}
+
+// Function to take the semaphore, failing with SEM_ERR_BUSY instead of waiting
+void ksyscall_sem_trywait()
+{
+	ksem_wait(0);
+}
+
+// Function to wait on the semaphore for at most ECX milliseconds
+void ksyscall_sem_timedwait()
+{
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	ksem_wait((int)pcb[run_pid]->trapframe_p->ecx);
+}
+
+// Helper function that checks the semaphore passed in EBX
+static int ksem_get()
 {
 	int *sem_num;
-	
+
 	if (run_pid < 0 || run_pid > PID_MAX)
 	{
 		panic("Invalid PID");
 	}
-	
-	// Obtain the passed semaphore from the trapframe
-	sem_num = (int *)pcb[run_pid].trapframe_p->ebx;
-	//sem_ptr = (int *)pcb[run_pid].trapframe_p->ebx;
-	
-	// check if the semaphore is valid or not
-	if (*sem_num < -1 || *sem_num > SEMAPHORE_MAX)
+
+	sem_num = (int *)pcb[run_pid]->trapframe_p->ebx;
+
+	if (sem_num == NULL || *sem_num < 0 || *sem_num >= SEMAPHORE_MAX || semaphores[*sem_num] == NULL)
 	{
 		panic("Invalid Semaphore");
 	}
-	
+
+	return *sem_num;
+}
+
+// Helper function that waits on a semaphore for the running process
+// timeout_ms: -1 waits forever, 0 never waits, otherwise the longest wait
+// The result is returned in EDX
+static void ksem_wait(int timeout_ms)
+{
+	int sem_num = ksem_get();
+
 	// if the semaphore count > 0, then ther eis atleast one process in the wait queue
-	if (semaphores[*sem_num].count > 0)
+	if (semaphores[sem_num]->count > 0)
 	{
-		if (enqueue(&semaphores[*sem_num].wait_q, run_pid) != 0)
+		if (timeout_ms == 0)
+		{
+			pcb[run_pid]->trapframe_p->edx = SEM_ERR_BUSY;
+			return;
+		}
+
+		// a timed wait is also put on the sleep list, ktimer_expire() ends it
+		if (timeout_ms > 0)
 		{
-			panic("Cannot Nq process");
+			pcb[run_pid]->timeout_fn = ksem_timeout;
+			ktimer_timeout(run_pid, ktimer_ms_to_ticks(timeout_ms));
 		}
-		pcb[run_pid].state = WAITING;
-		//run_pid = -1;
 
+		pcb[run_pid]->trapframe_p->edx = SEM_OK;
+		semaphores[sem_num]->count++;
+		kblock(&semaphores[sem_num]->wait_q);
+		return;
 	}
-	
-	semaphores[*sem_num].count++;
+
+	pcb[run_pid]->trapframe_p->edx = SEM_OK;
+	semaphores[sem_num]->count++;
 }
 
-// Function to tell the semaphore to post
-void ksyscall_sem_post()
+// Helper function that gives back the count a timed out waiter had taken
+static void ksem_timeout(int pid)
 {
-	int *sem_num;
-	int pid = -1;
-	
-	if (run_pid < 0 || run_pid > PID_MAX)
+	semaphores[*(int *)pcb[pid]->trapframe_p->ebx]->count--;
+}
+
+// Function to destroy a semaphore
+// Waiters are woken with SEM_ERR_DESTROYED, the semaphore goes back to its
+// cache and the ID goes back on semaphore_q
+void ksyscall_sem_destroy()
+{
+	int pid;
+	int sem_num = ksem_get();
+	int *sem_ptr = (int *)pcb[run_pid]->trapframe_p->ebx;
+
+	while (kqueue_pop(&semaphores[sem_num]->wait_q, &pid) == 0)
 	{
-		panic("Invalid PID");
+		ktimer_cancel(pid);
+		pcb[pid]->trapframe_p->edx = SEM_ERR_DESTROYED;
+		kproc_wake(pid);
 	}
-	
-	// obtain the semaphore from the trapframe
-	sem_num = (int *)pcb[run_pid].trapframe_p->ebx;
-	
-	// check if the semaphore is valid or not
-	if (*sem_num < 0 || *sem_num > SEMAPHORE_MAX)
+
+	kslab_free(&sem_cache, semaphores[sem_num]);
+	semaphores[sem_num] = NULL;
+	if (enqueue(&semaphore_q, sem_num) != 0)
 	{
-		panic("Invalid Semaphore");
+		panic("Cannot Nq semaphore");
 	}
 
-	// check if the semaphore has a process in waiting
-	if (semaphores[*sem_num].wait_q.size > 0){
+	*sem_ptr = SEMAPHORE_UNINITIALIZED;
+}
 
-		if (dequeue(&(semaphores[*sem_num].wait_q), &pid) != 0){
-			panic("Cannot dq process");
-		}
-		pcb[pid].state = READY;
-		enqueue(&run_q, pid);
+// Function to initialize a mutex, taking an ID from mutex_q
+void ksyscall_mutex_init()
+{
+	int mutex_num;
+	mutex_t *mutex_ptr;
 
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
 	}
-	if(semaphores[*sem_num].count > 0)
-		semaphores[*sem_num].count--;
-	/*
-	// how to check if hte process is in waiting?
-	if (semaphores[sem_num].wait_q.size > 0)
+
+	mutex_ptr = (mutex_t *)pcb[run_pid]->trapframe_p->ebx;
+
+	// a mutex that is already initialized is left alone
+	if (*mutex_ptr == MUTEX_UNINITIALIZED)
 	{
-		if (dequeue(&semaphores[sem_num].wait_q, &pid) != 0)
-		{
-			panic("Cannot Dq process");
-		}
-		
-		if (enqueue((pcb[pid].queue), pid) != 0)
+		if (dequeue(&mutex_q, &mutex_num) != 0)
 		{
-			panic("Cannot Nq process");
+			panic("Invalid Mutex");
 		}
-		pcb[pid].state = READY;
+		*mutex_ptr = mutex_num;
+		mutexes[mutex_num].owner = -1;
+		mutexes[mutex_num].init = MUTEX_INITIALIZED;
 	}
-	
-	if (semaphores[sem_num].count > 0)
-	{
-		semaphores[sem_num].count--;
-	}*/
 }
 
-// Function to send the message
-void ksyscall_msg_send()
+// Helper function that checks a mutex passed in by a process
+static int mutex_get(mutex_t *mutex_ptr)
 {
-	int mbox_num;
-	int waiting_pid = -1;
-	msg_t *msg_sender = NULL;
-	msg_t *msg_reciever = NULL;
-	
 	if (run_pid < 0 || run_pid > PID_MAX)
 	{
 		panic("Invalid PID");
 	}
-	
-	// retrieve the data from the kennel
-	msg_sender = (msg_t *)pcb[run_pid].trapframe_p->ebx;
-	mbox_num = pcb[run_pid].trapframe_p->ecx;
-	
-	// check if the message sender is valid
-	if(msg_sender == NULL)
+
+	if (mutex_ptr == NULL || *mutex_ptr < 0 || *mutex_ptr >= MUTEX_MAX || mutexes[*mutex_ptr].init != MUTEX_INITIALIZED)
 	{
-		panic("Invalid mailbox pointer");
+		panic("Invalid Mutex");
 	}
-	
-	// check if hte message box is valid
-	if (mbox_num < 0 || mbox_num > MBOX_MAX)
+
+	return *mutex_ptr;
+}
+
+// Function to lock a mutex, blocking while another process holds it
+void ksyscall_mutex_lock()
+{
+	if (kmutex_lock(run_pid, mutex_get((mutex_t *)pcb[run_pid]->trapframe_p->ebx)) != 0)
 	{
-		panic("Invalid mailbox indentifier");
+		run_pid = -1;
 	}
-	
-	// 
-	if (mbox_enqueue(msg_sender, mbox_num) != 0)
+}
+
+// Function to unlock a mutex held by the running process
+void ksyscall_mutex_unlock()
+{
+	kmutex_unlock(run_pid, mutex_get((mutex_t *)pcb[run_pid]->trapframe_p->ebx));
+}
+
+// Helper function that blocks the running process on a wait queue
+static void kblock(kqueue_t *queue)
+{
+	kqueue_push(queue, run_pid);
+	pcb[run_pid]->state = WAITING;
+	kproc_promote(run_pid);
+	run_pid = -1;
+}
+
+// Function to initialize a condition variable, taking an ID from cond_q
+void ksyscall_cond_init()
+{
+	int cond_num;
+	cond_t *cond_ptr;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
 	{
-		panic("Cannot Send Message");
+		panic("Invalid PID");
 	}
-	
-	// if the mailbox has a process in it...
-	if (mailboxes[mbox_num].wait_q.size > 0)
+
+	cond_ptr = (cond_t *)pcb[run_pid]->trapframe_p->ebx;
+
+	if (*cond_ptr == COND_UNINITIALIZED)
 	{
-		if (dequeue(&(mailboxes[mbox_num].wait_q), &waiting_pid) != 0)
-		{
-			panic("Cannot Dq waiting PID");
-		}
-		
-		if (enqueue(&run_q, waiting_pid) != 0)
+		if (dequeue(&cond_q, &cond_num) != 0)
 		{
-			panic("Cannot Nq waiting PID");
+			panic("Invalid Condition Variable");
 		}
-		pcb[waiting_pid].state = READY;
-		msg_reciever = (msg_t *)pcb[waiting_pid].trapframe_p->ebx;
-		mbox_dequeue(msg_reciever, mbox_num);
+		*cond_ptr = cond_num;
+		conds[cond_num].init = COND_INITIALIZED;
 	}
 }
 
-// Function to receive the message
-void ksyscall_msg_recv()
+// Helper function that checks the condition variable passed in EBX
+static int cond_get()
 {
-	int mbox_num;
-	msg_t *msg_reciever = NULL;
-	
-	// check if hte run_pid is valid
+	cond_t *cond_ptr;
+
 	if (run_pid < 0 || run_pid > PID_MAX)
 	{
 		panic("Invalid PID");
 	}
-	
-	msg_reciever = (msg_t *)pcb[run_pid].trapframe_p->ebx;
-	mbox_num = pcb[run_pid].trapframe_p->ecx;
-	
-	if (msg_reciever == NULL)
+
+	cond_ptr = (cond_t *)pcb[run_pid]->trapframe_p->ebx;
+
+	if (cond_ptr == NULL || *cond_ptr < 0 || *cond_ptr >= COND_MAX || conds[*cond_ptr].init != COND_INITIALIZED)
 	{
-		panic("Invalid mailbox pointer");
+		panic("Invalid Condition Variable");
 	}
-	
-	if (mbox_num < 0 || mbox_num > MBOX_MAX)
+
+	return *cond_ptr;
+}
+
+// Function to wait on a condition variable
+// EBX: condition variable, ECX: mutex held by the caller
+// The mutex is unlocked while waiting and locked again before returning
+void ksyscall_cond_wait()
+{
+	int pid = run_pid;
+	int cond_num = cond_get();
+	int mutex_num = mutex_get((mutex_t *)pcb[run_pid]->trapframe_p->ecx);
+
+	// block before unlocking so the process woken by the unlock cannot
+	// preempt the waiter onto a run queue
+	kblock(&conds[cond_num].wait_q);
+	kmutex_unlock(pid, mutex_num);
+}
+
+// Helper function that moves a signaled process over to its mutex; it is
+// only woken once it holds the mutex again. It stays blocked in between,
+// so it is not promoted again for waiting on the mutex.
+static void cond_wake(int pid)
+{
+	int mutex_num = *(mutex_t *)pcb[pid]->trapframe_p->ecx;
+
+	if (kmutex_relock(pid, mutex_num) == 0)
 	{
-		panic("Invalid mailbox indentifier");
+		kproc_wake(pid);
 	}
-	
-	// if the mailbox has a message...
-	if (mailboxes[mbox_num].size > 0)
+}
+
+// Function to wake one process waiting on a condition variable
+void ksyscall_cond_signal()
+{
+	int pid;
+	int cond_num = cond_get();
+
+	if (kqueue_pop(&conds[cond_num].wait_q, &pid) == 0)
 	{
-		if (mbox_dequeue(msg_reciever, mbox_num) != 0)
-		{
-			panic("No Message to Dq");
-		}
+		cond_wake(pid);
 	}
-	else
+}
+
+// Function to wake every process waiting on a condition variable
+void ksyscall_cond_broadcast()
+{
+	int pid;
+	int cond_num = cond_get();
+
+	while (kqueue_pop(&conds[cond_num].wait_q, &pid) == 0)
+	{
+		cond_wake(pid);
+	}
+}
+
+// Function to initialize a reader-writer lock, taking an ID from rwlock_q
+void ksyscall_rwlock_init()
+{
+	int rwlock_num;
+	rwlock_t *rwlock_ptr;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	rwlock_ptr = (rwlock_t *)pcb[run_pid]->trapframe_p->ebx;
+
+	if (*rwlock_ptr == RWLOCK_UNINITIALIZED)
 	{
-		if (enqueue(&(mailboxes[mbox_num].wait_q), run_pid) != 0)
+		if (dequeue(&rwlock_q, &rwlock_num) != 0)
 		{
-			panic("No Message to Nq");
+			panic("Invalid Reader-Writer Lock");
 		}
-		pcb[run_pid].state = WAITING;
-		run_pid = -1;
+		*rwlock_ptr = rwlock_num;
+		rwlocks[rwlock_num].readers = 0;
+		rwlocks[rwlock_num].writer = -1;
+		rwlocks[rwlock_num].init = RWLOCK_INITIALIZED;
 	}
-		
 }
 
-// Helper function for the enqueuing the messages for a given mailbox
-int mbox_enqueue(msg_t *msg, int mbox_num)
+// Helper function that checks the reader-writer lock passed in EBX
+static krwlock_t *rwlock_get()
 {
-	mailbox_t *mb;
-	if (msg == NULL)
+	rwlock_t *rwlock_ptr;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
 	{
-		panic("Message: INVALID"); // error checking
+		panic("Invalid PID");
 	}
 
-	if (mbox_num < 0 || mbox_num > MBOX_MAX)
+	rwlock_ptr = (rwlock_t *)pcb[run_pid]->trapframe_p->ebx;
+
+	if (rwlock_ptr == NULL || *rwlock_ptr < 0 || *rwlock_ptr >= RWLOCK_MAX || rwlocks[*rwlock_ptr].init != RWLOCK_INITIALIZED)
 	{
-		panic("Mailbox ID: INVALID"); // error checking
+		panic("Invalid Reader-Writer Lock");
 	}
-	mb = &mailboxes[mbox_num]; // easy pointer. DOUBLE CHECK
 
-	if (mb->size == MBOX_SIZE)
+	return &rwlocks[*rwlock_ptr];
+}
+
+// Function to lock a reader-writer lock for reading
+// Readers wait while a writer holds the lock or is waiting for it
+void ksyscall_rwlock_rdlock()
+{
+	krwlock_t *rwlock = rwlock_get();
+
+	if (rwlock->writer == -1 && rwlock->write_q.size == 0)
 	{
-		return -1; // if full
+		rwlock->readers++;
+		return;
 	}
-	
-	msg->sender = run_pid;  // get the receiving process ID
-	msg->time_sent = system_time / CLK_TCK; // new calculation?
-	sp_memcpy(&mb->messages[mb->tail], msg, sizeof(msg_t)); //From process to mailbox
-	mb->tail++;
-	
-	if (mb->tail == MBOX_SIZE)
+
+	kblock(&rwlock->read_q);
+}
+
+// Function to lock a reader-writer lock for writing
+void ksyscall_rwlock_wrlock()
+{
+	krwlock_t *rwlock = rwlock_get();
+
+	if (rwlock->writer == -1 && rwlock->readers == 0)
 	{
-		mb->tail = 0; // loop the queue
+		rwlock->writer = run_pid;
+		return;
 	}
-	mb->size++;
-	return 0; // it worked
+
+	kblock(&rwlock->write_q);
 }
 
-// Helper function for the dequeuing for the messages for a given mailbox
-int mbox_dequeue(msg_t *msg, int mbox_num)
+// Function to unlock a reader-writer lock held for reading or writing
+// The lock goes to the next writer, or to every waiting reader if no
+// writer is waiting
+void ksyscall_rwlock_unlock()
 {
-	mailbox_t *mb;
-	if (msg == NULL)
+	int pid;
+	krwlock_t *rwlock = rwlock_get();
+
+	if (rwlock->writer == run_pid)
 	{
-		panic("Message: INVALID"); // error checking
+		rwlock->writer = -1;
+	}
+	else if (rwlock->readers > 0)
+	{
+		rwlock->readers--;
+	}
+	else
+	{
+		panic("Reader-Writer Lock is not held by the process");
 	}
 
-	if (mbox_num < 0 || mbox_num > MBOX_MAX)
+	if (rwlock->writer != -1 || rwlock->readers > 0)
 	{
-		panic("Mailbox ID: INVALID"); // error checking
+		return;
 	}
-	
-	mb = &mailboxes[mbox_num]; // easy pointer. DOUBLE CHECK
 
-	if (mb->size == 0)
+	if (kqueue_pop(&rwlock->write_q, &pid) == 0)
 	{
-		return -1; // if empty
+		rwlock->writer = pid;
+		kproc_wake(pid);
+		return;
 	}
-	
-	sp_memcpy(msg, &mb->messages[mb->head], sizeof(msg_t)); // From mailbox to process
-	mb->head++;
-	
-	if (mb->head == MBOX_SIZE)
+
+	while (kqueue_pop(&rwlock->read_q, &pid) == 0)
 	{
-		mb->head = 0; // loop the queue 
+		rwlock->readers++;
+		kproc_wake(pid);
 	}
-	
-	mb->size--; 			// reduce size of Q
-	msg->time_received = system_time / CLK_TCK;	//system time / clock tick
-	return 0; // it worked
 }
 
+// Function to attach to a shared ring
+// EBX: ring number; the address of the ring is returned in EBX
+void ksyscall_ring_attach()
+{
+	int ring_num;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	ring_num = pcb[run_pid]->trapframe_p->ebx;
+
+	if (ring_num < 0 || ring_num >= RING_MAX)
+	{
+		panic("Invalid ring identifier");
+	}
+
+	pcb[run_pid]->trapframe_p->ebx = (unsigned int)&rings[ring_num];
+}
+
+// Helper function that finds a shared memory segment by name
+// Returns the segment number, -1 if there is none
+static int shm_find(char *name)
+{
+	int i;
+
+	if (name == NULL || name[0] == '\0')
+	{
+		panic("Invalid shared memory name");
+	}
+
+	for (i = 0; i < SHM_MAX; i++)
+	{
+		if (shm_segs[i].refs > 0 && sp_strncmp(shm_segs[i].name, name, SHM_NAME_LEN) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// Function to create a named shared memory segment
+// EBX: name, ECX: size in bytes; the address is returned in EBX, or 0 if
+// the name is taken or there is no room
+void ksyscall_shm_create()
+{
+	int i;
+	int size;
+	char *name;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	name = (char *)pcb[run_pid]->trapframe_p->ebx;
+	size = pcb[run_pid]->trapframe_p->ecx;
+	pcb[run_pid]->trapframe_p->ebx = 0;
+
+	if (size <= 0)
+	{
+		panic("Invalid shared memory size");
+	}
+
+	if (shm_find(name) != -1)
+	{
+		return;
+	}
+
+	for (i = 0; i < SHM_MAX; i++)
+	{
+		if (shm_segs[i].refs == 0)
+		{
+			shm_segs[i].pages = (size + KPAGE_SIZE - 1) / KPAGE_SIZE;
+			shm_segs[i].addr = kpage_alloc(shm_segs[i].pages);
+			if (shm_segs[i].addr == NULL)
+			{
+				return;
+			}
+
+			sp_memset(shm_segs[i].addr, 0, shm_segs[i].pages * KPAGE_SIZE);
+			kvm_map(run_pid, shm_segs[i].addr, shm_segs[i].pages);
+			sp_strncpy(shm_segs[i].name, name, SHM_NAME_LEN);
+			shm_segs[i].name[SHM_NAME_LEN] = '\0';
+			shm_segs[i].size = size;
+			shm_segs[i].refs = 1;
+			pcb[run_pid]->shm_refs[i] = 1;
+			pcb[run_pid]->trapframe_p->ebx = (unsigned int)shm_segs[i].addr;
+			return;
+		}
+	}
+}
+
+// Function to attach to a named shared memory segment
+// EBX: name; the address is returned in EBX, or 0 if there is no such segment
+void ksyscall_shm_attach()
+{
+	int shm_num;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	shm_num = shm_find((char *)pcb[run_pid]->trapframe_p->ebx);
+	if (shm_num == -1)
+	{
+		pcb[run_pid]->trapframe_p->ebx = 0;
+		return;
+	}
+
+	shm_segs[shm_num].refs++;
+	if (pcb[run_pid]->shm_refs[shm_num]++ == 0)
+	{
+		kvm_map(run_pid, shm_segs[shm_num].addr, shm_segs[shm_num].pages);
+	}
+	pcb[run_pid]->trapframe_p->ebx = (unsigned int)shm_segs[shm_num].addr;
+}
+
+// Function to detach from a named shared memory segment
+// EBX: name; the pages are freed when the last process detaches
+void ksyscall_shm_detach()
+{
+	int shm_num;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	shm_num = shm_find((char *)pcb[run_pid]->trapframe_p->ebx);
+	if (shm_num == -1)
+	{
+		panic("Invalid shared memory name");
+	}
+
+	if (pcb[run_pid]->shm_refs[shm_num] == 0)
+	{
+		panic("Shared memory segment not attached");
+	}
+
+	if (--pcb[run_pid]->shm_refs[shm_num] == 0)
+	{
+		kvm_unmap(run_pid, shm_segs[shm_num].addr, shm_segs[shm_num].pages);
+	}
+
+	shm_release(shm_num, 1);
+}
+
+// Helper function that drops references to a shared memory segment; the
+// pages are freed with the last one
+static void shm_release(int shm_num, int refs)
+{
+	shm_segs[shm_num].refs -= refs;
+	if (shm_segs[shm_num].refs == 0)
+	{
+		kpage_free(shm_segs[shm_num].addr, shm_segs[shm_num].pages);
+		sp_memset(&shm_segs[shm_num], 0, sizeof(shm_t));
+	}
+}
+
+// Function to detach an exiting process from the shared memory segments it
+// still holds. Its address space goes away with it, so nothing is unmapped.
+void shm_exit(int pid)
+{
+	int i;
+
+	for (i = 0; i < SHM_MAX; i++)
+	{
+		if (pcb[pid]->shm_refs[i] > 0)
+		{
+			shm_release(i, pcb[pid]->shm_refs[i]);
+			pcb[pid]->shm_refs[i] = 0;
+		}
+	}
+}
+
+// Helper function that checks the topic number passed in by a process
+static int topic_get(int topic_num)
+{
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	if (topic_num < 0 || topic_num >= TOPIC_MAX)
+	{
+		panic("Invalid topic identifier");
+	}
+
+	return topic_num;
+}
+
+// Function to subscribe to a topic
+// EBX: topic number; 0 is returned in EDX on success, -1 if the topic is full
+void ksyscall_topic_subscribe()
+{
+	int topic_num = topic_get(pcb[run_pid]->trapframe_p->ebx);
+
+	pcb[run_pid]->trapframe_p->edx = ktopic_subscribe(run_pid, topic_num);
+}
+
+// Function to unsubscribe from a topic
+// EBX: topic number
+void ksyscall_topic_unsubscribe()
+{
+	ktopic_unsubscribe(run_pid, topic_get(pcb[run_pid]->trapframe_p->ebx));
+}
+
+// Function to publish a message to every subscriber of a topic
+// EBX: message, ECX: topic number, EDX: data length; the result is
+// returned in EDX
+void ksyscall_topic_publish()
+{
+	int pid = run_pid;
+	int topic_num = topic_get(pcb[run_pid]->trapframe_p->ecx);
+	int len = pcb[run_pid]->trapframe_p->edx;
+	msg_t *msg = (msg_t *)pcb[run_pid]->trapframe_p->ebx;
+
+	if (msg == NULL || len < 0 || len > MSG_SIZE)
+	{
+		panic("Invalid message");
+	}
+
+	// waking subscribers may preempt the publisher, so run_pid is not used after
+	pcb[pid]->trapframe_p->edx = ktopic_publish(pid, topic_num, msg, len);
+}
+
+// Function to receive the next message published to a subscribed topic
+// EBX: message, ECX: topic number; the data length is returned in EDX
+void ksyscall_topic_recv()
+{
+	int len;
+	int topic_num = topic_get(pcb[run_pid]->trapframe_p->ecx);
+	msg_t *msg = (msg_t *)pcb[run_pid]->trapframe_p->ebx;
+
+	if (msg == NULL)
+	{
+		panic("Invalid message");
+	}
+
+	len = ktopic_recv(run_pid, topic_num, msg);
+	if (len >= 0)
+	{
+		pcb[run_pid]->trapframe_p->edx = len;
+		return;
+	}
+
+	kblock(&topics[topic_num].wait_q);
+}
+
+// Helper function that finds the wait queue for a futex address
+static kqueue_t *futex_bucket(int *addr)
+{
+	return &futex_q[((unsigned int)addr >> 2) % FUTEX_BUCKETS];
+}
+
+// Function to block on a futex
+// EBX: address of the user space word, ECX: the value the caller last saw
+// The process only blocks if the word still holds that value; otherwise it
+// changed since the caller looked and -1 is returned in EDX
+void ksyscall_futex_wait()
+{
+	int *addr;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	addr = (int *)pcb[run_pid]->trapframe_p->ebx;
+
+	if (addr == NULL)
+	{
+		panic("Invalid futex address");
+	}
+
+	// nothing can run between this check and blocking, so no wakeup is lost
+	if (*addr != (int)pcb[run_pid]->trapframe_p->ecx)
+	{
+		pcb[run_pid]->trapframe_p->edx = -1;
+		return;
+	}
+
+	pcb[run_pid]->trapframe_p->edx = 0;
+	kblock(futex_bucket(addr));
+}
+
+// Function to wake processes blocked on a futex
+// EBX: address of the user space word, ECX: most processes to wake
+// The number of processes woken is returned in EDX
+void ksyscall_futex_wake()
+{
+	int pid;
+	int next;
+	int max;
+	int woken = 0;
+	int caller = run_pid;
+	trapframe_t *tf;
+	int *addr;
+
+	if (caller < 0 || caller > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	// waking a higher priority waiter preempts the caller and clears
+	// run_pid, so only the cached trapframe is used from here on
+	tf = pcb[caller]->trapframe_p;
+	addr = (int *)tf->ebx;
+	max = (int)tf->ecx;
+
+	// other addresses may share the bucket, walk it once
+	for (pid = futex_bucket(addr)->head; pid != -1 && woken < max; pid = next)
+	{
+		next = pcb[pid]->queue_next;
+
+		if ((int *)pcb[pid]->trapframe_p->ebx == addr)
+		{
+			kqueue_remove(pid);
+			woken++;
+			kproc_wake(pid);
+		}
+	}
+
+	tf->edx = woken;
+}
+
+// Function to tell the semaphore to post
+void ksyscall_sem_post()
+{
+	int pid = -1;
+	int sem_num = ksem_get();
+
+	// check if the semaphore has a process in waiting
+	if (semaphores[sem_num]->wait_q.size > 0){
+
+		if (kqueue_pop(&(semaphores[sem_num]->wait_q), &pid) != 0){
+			panic("Cannot dq process");
+		}
+		ktimer_cancel(pid);
+		kproc_wake(pid);
+
+	}
+	if(semaphores[sem_num]->count > 0)
+		semaphores[sem_num]->count--;
+}
+
+// Helper function that returns a mailbox, creating it from its object cache
+// the first time it is used
+static mailbox_t *mbox_get(int mbox_num)
+{
+	int prio;
+	mailbox_t *mb;
+
+	if (mbox_num < 0 || mbox_num >= MBOX_MAX)
+	{
+		panic("Invalid mailbox indentifier");
+	}
+
+	if (mailboxes[mbox_num] != NULL)
+	{
+		return mailboxes[mbox_num];
+	}
+
+	mb = kslab_alloc(&mbox_cache);
+	if (mb == NULL)
+	{
+		panic("Out of memory for mailboxes");
+	}
+
+	// only the header is set up, ring bytes are always written before they are read
+	mb->head = 0;
+	mb->tail = 0;
+	mb->used = 0;
+	mb->size = 0;
+	for (prio = 0; prio < MSG_PRIO_LEVELS; prio++)
+	{
+		mb->band_head[prio] = -1;
+		mb->band_tail[prio] = -1;
+	}
+	mb->band_bitmap = 0;
+	kqueue_init(&mb->wait_q);
+	kqueue_init(&mb->send_q);
+	kqueue_init(&mb->select_q);
+
+	mailboxes[mbox_num] = mb;
+	return mb;
+}
+
+// Helper function that blocks the running process on a mailbox queue, in
+// front of process next (-1 for the tail)
+static void mbox_block_before(kqueue_t *queue, int next)
+{
+	kqueue_insert(queue, run_pid, next);
+	pcb[run_pid]->state = WAITING;
+	kproc_promote(run_pid);
+	run_pid = -1;
+}
+
+// Helper function that blocks the running process on a mailbox queue
+static void mbox_block(kqueue_t *queue)
+{
+	mbox_block_before(queue, -1);
+}
+
+// Helper function that blocks the running process on a mailbox's send
+// queue behind the senders of its own or a more urgent band, so urgent
+// messages get the room a receiver makes before bulk traffic does
+static void mbox_block_sender(mailbox_t *mb, int prio)
+{
+	int next = mb->send_q.head;
+
+	while (next != -1 && mbox_prio(pcb[next]->trapframe_p) <= prio)
+	{
+		next = pcb[next]->queue_next;
+	}
+
+	mbox_block_before(&(mb->send_q), next);
+}
+
+// Helper function that checks whether a sender in a band may queue its
+// message now: only blocked senders of the same or a more urgent band go first
+static int mbox_may_send(mailbox_t *mb, int prio)
+{
+	return mb->send_q.size == 0 || mbox_prio(pcb[mb->send_q.head]->trapframe_p) > prio;
+}
+
+// Function to send the message, blocking while the mailbox is full
+void ksyscall_msg_send()
+{
+	mbox_send(1);
+}
+
+// Function to send the message, failing with MSG_ERR_FULL if the mailbox is full
+void ksyscall_msg_trysend()
+{
+	mbox_send(0);
+}
+
+// Function to send the message in the priority band given in ESI,
+// blocking while the mailbox is full
+void ksyscall_msg_send_prio()
+{
+	mbox_send(1);
+}
+
+// Helper function that returns the priority band a sender asked for
+static int mbox_prio(trapframe_t *tf)
+{
+	if (tf->eax != SYSCALL_MSG_SEND_PRIO)
+	{
+		return MSG_PRIO_DEFAULT;
+	}
+
+	if ((int)tf->esi < MSG_PRIO_HIGH || (int)tf->esi > MSG_PRIO_LOW)
+	{
+		panic("Invalid message priority");
+	}
+
+	return tf->esi;
+}
+
+// Helper function that sends the message described by the running process' trapframe
+static void mbox_send(int block)
+{
+	int mbox_num;
+	mailbox_t *mb;
+	int len;
+	int prio;
+	int waiting_pid = -1;
+	msg_t *msg_sender = NULL;
+	msg_t *msg_reciever = NULL;
+	msg_vec_t *msg_vec = NULL;
+	
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+	
+	// retrieve the data from the kennel
+	msg_sender = (msg_t *)pcb[run_pid]->trapframe_p->ebx;
+	mbox_num = pcb[run_pid]->trapframe_p->ecx;
+	len = pcb[run_pid]->trapframe_p->edx;
+	
+	// check if the message sender is valid
+	if(msg_sender == NULL)
+	{
+		panic("Invalid mailbox pointer");
+	}
+	
+	// check if hte message box is valid
+	// the mailbox is created the first time it is used
+	mb = mbox_get(mbox_num);
+
+	// check if the message length is valid
+	if (len < 0 || len > MSG_SIZE)
+	{
+		panic("Invalid message length");
+	}
+
+	prio = mbox_prio(pcb[run_pid]->trapframe_p);
+	
+	// if a receiver is already waiting, the mailbox is empty: copy the
+	// message straight into the receiver's buffer
+	if (mb->wait_q.size > 0)
+	{
+		if (kqueue_pop(&(mb->wait_q), &waiting_pid) != 0)
+		{
+			panic("Cannot Dq waiting PID");
+		}
+		ktimer_cancel(waiting_pid);
+		
+		// a batch receiver gets the message in the first entry of its vector
+		if (pcb[waiting_pid]->trapframe_p->eax == SYSCALL_MSG_RECVV)
+		{
+			msg_vec = (msg_vec_t *)pcb[waiting_pid]->trapframe_p->ebx;
+			msg_reciever = msg_vec[0].msg;
+			msg_vec[0].len = len;
+			pcb[waiting_pid]->trapframe_p->edx = 1;		// received count
+		}
+		else
+		{
+			msg_reciever = (msg_t *)pcb[waiting_pid]->trapframe_p->ebx;
+			pcb[waiting_pid]->trapframe_p->edx = len;	// received length
+		}
+
+		msg_reciever->sender = run_pid;
+		msg_reciever->time_sent = (int)(system_time / CLK_TCK);
+		msg_reciever->time_received = msg_reciever->time_sent;
+		sp_memcpy(msg_reciever->data, msg_sender->data, len);
+		pcb[run_pid]->trapframe_p->edx = MSG_OK;
+		mbox_record_delay(prio, 0);						// never queued
+
+		// Switch straight to the receiver unless it has a lower priority
+		if (ipc_direct_switch && pcb[waiting_pid]->priority <= pcb[run_pid]->priority)
+			kproc_handoff(waiting_pid);
+		else
+			kproc_wake(waiting_pid);
+		return;
+	}
+
+	// senders already waiting for room go first, unless they are less urgent
+	if (mbox_may_send(mb, prio) && mbox_enqueue(msg_sender, len, mbox_num, run_pid, prio) == 0)
+	{
+		pcb[run_pid]->trapframe_p->edx = MSG_OK;
+		mbox_wake_receivers(mbox_num);			// tells a selector the mailbox is ready
+		return;
+	}
+
+	if (!block)
+	{
+		pcb[run_pid]->trapframe_p->edx = MSG_ERR_FULL;
+		return;
+	}
+
+	// wait for a receiver to make room, mbox_wake_senders() completes the send
+	mbox_block_sender(mb, prio);
+}
+
+// Function to receive the message, waiting as long as it takes
+void ksyscall_msg_recv()
+{
+	mbox_recv(-1);
+}
+
+// Function to receive the message, waiting at most EDX milliseconds
+void ksyscall_msg_recv_timeout()
+{
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	mbox_recv((int)pcb[run_pid]->trapframe_p->edx);
+}
+
+// Function to receive the message, failing with MSG_ERR_EMPTY if there is none
+void ksyscall_msg_tryrecv()
+{
+	mbox_recv(0);
+}
+
+// Function to wait until any mailbox in a set has a message
+// EBX: mailbox numbers, ECX: count, EDX: timeout in ms (-1 forever, 0 poll)
+// The ready mailbox number (or an error) is returned in EDX; the message is
+// left in the mailbox for msg_recv/msg_tryrecv.
+void ksyscall_msg_select()
+{
+	int i;
+	int count;
+	int timeout_ms;
+	int *mbox_set = NULL;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	mbox_set = (int *)pcb[run_pid]->trapframe_p->ebx;
+	count = pcb[run_pid]->trapframe_p->ecx;
+	timeout_ms = pcb[run_pid]->trapframe_p->edx;
+
+	if (mbox_set == NULL || count <= 0 || count > MBOX_MAX)
+	{
+		panic("Invalid mailbox set");
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		// a mailbox already holds a message: no need to wait
+		if (mbox_get(mbox_set[i])->size > 0)
+		{
+			pcb[run_pid]->trapframe_p->edx = mbox_set[i];
+			return;
+		}
+	}
+
+	if (timeout_ms == 0)
+	{
+		pcb[run_pid]->trapframe_p->edx = MSG_ERR_EMPTY;
+		return;
+	}
+
+	// wait on every mailbox in the set; the first one to get a message
+	// takes the process off the others
+	for (i = 0; i < count; i++)
+	{
+		mbox_select_add(mbox_set[i], run_pid);
+	}
+
+	if (timeout_ms > 0)
+	{
+		pcb[run_pid]->timeout_fn = mbox_select_cancel;
+		ktimer_timeout(run_pid, ktimer_ms_to_ticks(timeout_ms));
+	}
+
+	pcb[run_pid]->state = WAITING;
+	kproc_promote(run_pid);
+	run_pid = -1;
+}
+
+// Helper function that receives a message for the running process
+// timeout_ms: -1 waits forever, 0 never waits, otherwise the longest wait
+static void mbox_recv(int timeout_ms)
+{
+	int mbox_num;
+	mailbox_t *mb;
+	int len;
+	msg_t *msg_reciever = NULL;
+	
+	// check if hte run_pid is valid
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+	
+	msg_reciever = (msg_t *)pcb[run_pid]->trapframe_p->ebx;
+	mbox_num = pcb[run_pid]->trapframe_p->ecx;
+	
+	if (msg_reciever == NULL)
+	{
+		panic("Invalid mailbox pointer");
+	}
+	
+	// the mailbox is created the first time it is used
+	mb = mbox_get(mbox_num);
+	
+	// if the mailbox has a message...
+	if (mb->size > 0)
+	{
+		if ((len = mbox_dequeue(msg_reciever, mbox_num)) < 0)
+		{
+			panic("No Message to Dq");
+		}
+		pcb[run_pid]->trapframe_p->edx = len;		// received length
+		mbox_wake_senders(mbox_num);				// room was made
+	}
+	else if (timeout_ms == 0)
+	{
+		pcb[run_pid]->trapframe_p->edx = MSG_ERR_EMPTY;
+	}
+	else
+	{
+		// a timed wait is also put on the sleep list, ktimer_expire() ends it
+		if (timeout_ms > 0)
+		{
+			ktimer_timeout(run_pid, ktimer_ms_to_ticks(timeout_ms));
+		}
+		mbox_block(&(mb->wait_q));
+	}
+		
+}
+
+// Function to send a batch of messages with a single kernel entry
+void ksyscall_msg_sendv()
+{
+	int i;
+	int count;
+	int mbox_num;
+	int pid = run_pid;
+	trapframe_t *tf;
+	mailbox_t *mb;
+	msg_vec_t *msg_vec = NULL;
+	kqueue_t woken;
+
+	if (pid < 0 || pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	tf = pcb[pid]->trapframe_p;
+	msg_vec = (msg_vec_t *)tf->ebx;
+	count = tf->ecx;
+	mbox_num = tf->edx;
+
+	if (msg_vec == NULL || count < 0)
+	{
+		panic("Invalid message vector");
+	}
+
+	// the mailbox is created the first time it is used
+	mb = mbox_get(mbox_num);
+
+	for (i = 0; i < count; i++)
+	{
+		if (msg_vec[i].msg == NULL || msg_vec[i].len < 0 || msg_vec[i].len > MSG_SIZE)
+		{
+			panic("Invalid message vector");
+		}
+	}
+
+	// senders already waiting for room go first, unless they are less urgent
+	kqueue_init(&woken);
+	if (mbox_may_send(mb, MSG_PRIO_DEFAULT))
+	{
+		mbox_sendv_some(pid, mbox_num, &woken);
+	}
+
+	// wait for a receiver to make room for the rest, mbox_wake_senders() completes the send.
+	// This is decided before any receiver is woken: a woken receiver may preempt the sender.
+	if (tf->ecx > 0)
+	{
+		mbox_block_sender(mb, MSG_PRIO_DEFAULT);
+	}
+
+	mbox_wake_list(&woken);
+	mbox_wake_receivers(mbox_num);
+}
+
+// Function to receive up to a batch of messages with a single kernel entry
+void ksyscall_msg_recvv()
+{
+	int max;
+	int mbox_num;
+	mailbox_t *mb;
+	msg_vec_t *msg_vec = NULL;
+
+	if (run_pid < 0 || run_pid > PID_MAX)
+	{
+		panic("Invalid PID");
+	}
+
+	msg_vec = (msg_vec_t *)pcb[run_pid]->trapframe_p->ebx;
+	max = pcb[run_pid]->trapframe_p->ecx;
+	mbox_num = pcb[run_pid]->trapframe_p->edx;
+
+	if (msg_vec == NULL || max <= 0)
+	{
+		panic("Invalid message vector");
+	}
+
+	// the mailbox is created the first time it is used
+	mb = mbox_get(mbox_num);
+
+	// take whatever is queued, otherwise wait for the next message(s)
+	if (mb->size > 0)
+	{
+		pcb[run_pid]->trapframe_p->edx = mbox_dequeuev(msg_vec, max, mbox_num);	// received count
+		mbox_wake_senders(mbox_num);				// room was made
+	}
+	else
+	{
+		mbox_block(&(mb->wait_q));
+	}
+}
+
+// Helper function that completes the msg_recv/msg_recvv call of a blocked
+// receiver with the messages queued in the mailbox
+static void mbox_deliver(int pid, int mbox_num)
+{
+	trapframe_t *tf = pcb[pid]->trapframe_p;
+
+	if (tf->eax == SYSCALL_MSG_RECVV)
+	{
+		tf->edx = mbox_dequeuev((msg_vec_t *)tf->ebx, tf->ecx, mbox_num);	// received count
+	}
+	else
+	{
+		tf->edx = mbox_dequeue((msg_t *)tf->ebx, mbox_num);				// received length
+	}
+}
+
+// Helper function that wakes up processes waiting on a mailbox for as long
+// as it has messages for them
+static void mbox_wake_receivers(int mbox_num)
+{
+	kqueue_t woken;
+
+	kqueue_init(&woken);
+	mbox_deliver_waiting(mbox_num, &woken);
+	mbox_wake_list(&woken);
+
+	// messages left over go to a process selecting on this mailbox
+	if (mailboxes[mbox_num]->size > 0 && mailboxes[mbox_num]->select_q.size > 0)
+	{
+		mbox_wake_selector(mbox_num);
+	}
+}
+
+// Helper function that completes the receive of processes waiting on a
+// mailbox for as long as it has messages for them. The receivers are moved
+// to the woken queue but not woken yet, so the caller cannot be preempted.
+static void mbox_deliver_waiting(int mbox_num, kqueue_t *woken)
+{
+	int pid;
+
+	while (mailboxes[mbox_num]->size > 0 && mailboxes[mbox_num]->wait_q.size > 0)
+	{
+		if (kqueue_pop(&(mailboxes[mbox_num]->wait_q), &pid) != 0)
+		{
+			panic("Cannot Dq waiting PID");
+		}
+
+		ktimer_cancel(pid);
+		mbox_deliver(pid, mbox_num);
+		kqueue_push(woken, pid);
+	}
+}
+
+// Helper function that wakes up the receivers collected by mbox_deliver_waiting()
+static void mbox_wake_list(kqueue_t *woken)
+{
+	int pid;
+
+	while (kqueue_pop(woken, &pid) == 0)
+	{
+		kproc_wake(pid);
+	}
+}
+
+// Helper function that wakes the first process selecting on a mailbox that
+// just got a message. Only the mailbox sets of the woken process are walked.
+static void mbox_wake_selector(int mbox_num)
+{
+	int pid = mailboxes[mbox_num]->select_q.head;
+
+	ktimer_cancel(pid);
+	mbox_select_cancel(pid);
+	pcb[pid]->trapframe_p->edx = mbox_num;		// ready mailbox
+	kproc_wake(pid);
+}
+
+// Helper function that adds a selecting process to the tail of a mailbox's
+// select queue. Each mailbox has its own links in the PCB, so a process can
+// wait on all of its mailboxes at once.
+static void mbox_select_add(int mbox_num, int pid)
+{
+	kqueue_t *select_q = &(mailboxes[mbox_num]->select_q);
+
+	// a mailbox listed twice in the set is only waited on once
+	if (pcb[pid]->select_mask & (1 << mbox_num))
+	{
+		return;
+	}
+
+	pcb[pid]->select_mask |= 1 << mbox_num;
+	pcb[pid]->select_prev[mbox_num] = select_q->tail;
+	pcb[pid]->select_next[mbox_num] = -1;
+
+	if (select_q->tail == -1)
+	{
+		select_q->head = pid;
+	}
+	else
+	{
+		pcb[select_q->tail]->select_next[mbox_num] = pid;
+	}
+
+	select_q->tail = pid;
+	select_q->size++;
+}
+
+// Helper function that unlinks a selecting process from a mailbox's select queue
+static void mbox_select_del(int mbox_num, int pid)
+{
+	kqueue_t *select_q = &(mailboxes[mbox_num]->select_q);
+	int prev = pcb[pid]->select_prev[mbox_num];
+	int next = pcb[pid]->select_next[mbox_num];
+
+	if (prev == -1)
+	{
+		select_q->head = next;
+	}
+	else
+	{
+		pcb[prev]->select_next[mbox_num] = next;
+	}
+
+	if (next == -1)
+	{
+		select_q->tail = prev;
+	}
+	else
+	{
+		pcb[next]->select_prev[mbox_num] = prev;
+	}
+
+	select_q->size--;
+	pcb[pid]->select_mask &= ~(1 << mbox_num);
+}
+
+// Helper function that takes a selecting process off the select queues of
+// every mailbox in its set, in O(1) per mailbox
+static void mbox_select_cancel(int pid)
+{
+	int mbox_num;
+
+	for (mbox_num = 0; pcb[pid]->select_mask != 0; mbox_num++)
+	{
+		if (pcb[pid]->select_mask & (1 << mbox_num))
+		{
+			mbox_select_del(mbox_num, pid);
+		}
+	}
+}
+
+// Helper function that queues as much of a sender's message vector as fits,
+// handing messages to waiting receivers once per pass; the receivers are
+// collected in woken for the caller to wake. The sender's trapframe is
+// advanced past the messages sent, so a blocked sendv can be resumed later.
+static void mbox_sendv_some(int pid, int mbox_num, kqueue_t *woken)
+{
+	trapframe_t *tf = pcb[pid]->trapframe_p;
+	msg_vec_t *msg_vec;
+	int sent;
+
+	do
+	{
+		msg_vec = (msg_vec_t *)tf->ebx;
+		sent = 0;
+
+		while (tf->ecx > 0 && mbox_enqueue(msg_vec[sent].msg, msg_vec[sent].len, mbox_num, pid, MSG_PRIO_DEFAULT) == 0)
+		{
+			sent++;
+			tf->ecx--;
+		}
+
+		tf->ebx = (unsigned int)&msg_vec[sent];
+		mbox_deliver_waiting(mbox_num, woken);		// may make room for more
+	} while (tf->ecx > 0 && sent > 0);
+}
+
+// Helper function that completes the sends of blocked senders, most urgent
+// band first and in FIFO order within a band, for as long as their messages
+// fit in the mailbox
+static void mbox_wake_senders(int mbox_num)
+{
+	int pid;
+	trapframe_t *tf;
+	kqueue_t *send_q = &(mailboxes[mbox_num]->send_q);
+	kqueue_t woken;
+
+	kqueue_init(&woken);
+
+	while (send_q->size > 0)
+	{
+		pid = send_q->head;					// oldest blocked sender
+		tf = pcb[pid]->trapframe_p;
+
+		if (tf->eax == SYSCALL_MSG_SENDV)
+		{
+			mbox_sendv_some(pid, mbox_num, &woken);
+			if (tf->ecx > 0)
+			{
+				break;								// still waiting for room
+			}
+		}
+		else if (mbox_enqueue((msg_t *)tf->ebx, tf->edx, mbox_num, pid, mbox_prio(tf)) != 0)
+		{
+			break;									// still waiting for room
+		}
+		else
+		{
+			tf->edx = MSG_OK;
+		}
+
+		if (kqueue_pop(send_q, &pid) != 0)
+		{
+			panic("Cannot Dq waiting PID");
+		}
+		kproc_wake(pid);
+	}
+
+	mbox_wake_list(&woken);
+	mbox_wake_receivers(mbox_num);
+}
+
+// Helper function to copy bytes into a mailbox ring at an offset, wrapping around at the end
+static void mbox_ring_put(mailbox_t *mb, int off, const void *src, int n)
+{
+	int first = MBOX_BYTES - off;
+
+	if (first > n)
+	{
+		first = n;
+	}
+
+	sp_memcpy(&mb->ring[off], src, first);
+	sp_memcpy(&mb->ring[0], (const unsigned char *)src + first, n - first);
+}
+
+// Helper function to copy bytes out of a mailbox ring at an offset, wrapping around at the end
+static void mbox_ring_get(mailbox_t *mb, int off, void *dest, int n)
+{
+	int first = MBOX_BYTES - off;
+
+	if (first > n)
+	{
+		first = n;
+	}
+
+	sp_memcpy(dest, &mb->ring[off], first);
+	sp_memcpy((unsigned char *)dest + first, &mb->ring[0], n - first);
+}
+
+// Helper function that moves a ring offset along with the bytes that
+// mbox_ring_remove moved up: the d bytes from head on move n bytes up
+static int mbox_ring_shift(int off, int head, int d, int n)
+{
+	if (off != -1 && (off - head + MBOX_BYTES) % MBOX_BYTES < d)
+	{
+		return (off + n) % MBOX_BYTES;
+	}
+
+	return off;
+}
+
+// Helper function that removes a received record of n bytes from a
+// mailbox ring. The records written before it are moved up over it, so
+// its space is free right away, even while older messages of a less
+// urgent band are still waiting at the head of the ring. Receiving the
+// oldest record moves nothing.
+static void mbox_ring_remove(mailbox_t *mb, int off, int n)
+{
+	int i;
+	int prio;
+	int head = mb->head;
+	int d = (off - head + MBOX_BYTES) % MBOX_BYTES;		// bytes written before the record
+	mbox_rec_t rec;
+
+	// copy from the top down, the two ranges overlap
+	for (i = d - 1; i >= 0; i--)
+	{
+		mb->ring[(head + n + i) % MBOX_BYTES] = mb->ring[(head + i) % MBOX_BYTES];
+	}
+
+	mb->head = (head + n) % MBOX_BYTES;
+	mb->used -= n;
+
+	if (d == 0)
+	{
+		return;
+	}
+
+	// fix the band lists that point at the moved records
+	for (prio = MSG_PRIO_HIGH; prio < MSG_PRIO_LEVELS; prio++)
+	{
+		mb->band_head[prio] = mbox_ring_shift(mb->band_head[prio], head, d, n);
+		mb->band_tail[prio] = mbox_ring_shift(mb->band_tail[prio], head, d, n);
+	}
+
+	for (off = mb->head, i = 0; i < mb->used; i += sizeof(mbox_rec_t) + rec.len)
+	{
+		mbox_ring_get(mb, (off + i) % MBOX_BYTES, &rec, sizeof(mbox_rec_t));
+		rec.next = mbox_ring_shift(rec.next, head, d, n);
+		mbox_ring_put(mb, (off + i) % MBOX_BYTES, &rec, sizeof(mbox_rec_t));
+	}
+}
+
+// Helper function for the enqueuing the messages for a given mailbox
+// Only the first len bytes of the message data are stored. Records are
+// written in arrival order and linked into the list of their priority band.
+int mbox_enqueue(msg_t *msg, int len, int mbox_num, int sender, int prio)
+{
+	mailbox_t *mb;
+	mbox_rec_t rec;
+	mbox_rec_t prev;
+	int off;
+
+	if (msg == NULL)
+	{
+		panic("Message: INVALID"); // error checking
+	}
+
+	mb = mbox_get(mbox_num); // easy pointer, created on first use
+
+	if (mb->used + (int)sizeof(mbox_rec_t) + len > MBOX_BYTES)
+	{
+		return -1; // if full
+	}
+	
+	rec.sender = sender;  // get the sending process ID
+	rec.time_sent = (int)(system_time / CLK_TCK); // new calculation?
+	rec.len = len;
+	rec.prio = prio;
+	rec.next = -1;
+	rec.tsc = (unsigned int)ktimer_rdtsc();
+
+	off = mb->tail;
+	mbox_ring_put(mb, off, &rec, sizeof(mbox_rec_t));								// record header
+	mbox_ring_put(mb, (off + sizeof(mbox_rec_t)) % MBOX_BYTES, msg->data, len);	// From process to mailbox
+	mb->tail = (off + sizeof(mbox_rec_t) + len) % MBOX_BYTES;
+	mb->used += sizeof(mbox_rec_t) + len;
+
+	// append to the band: O(1) through its tail
+	if (mb->band_tail[prio] != -1)
+	{
+		mbox_ring_get(mb, mb->band_tail[prio], &prev, sizeof(mbox_rec_t));
+		prev.next = off;
+		mbox_ring_put(mb, mb->band_tail[prio], &prev, sizeof(mbox_rec_t));
+	}
+	else
+	{
+		mb->band_head[prio] = off;
+	}
+	mb->band_tail[prio] = off;
+	mb->band_bitmap |= 1 << prio;
+	
+	mb->size++;
+	return 0; // it worked
+}
+
+// Helper function for dequeuing up to max messages into a message vector
+// Returns the number of messages dequeued
+int mbox_dequeuev(msg_vec_t *msg_vec, int max, int mbox_num)
+{
+	int i;
+
+	for (i = 0; i < max && mailboxes[mbox_num]->size > 0; i++)
+	{
+		msg_vec[i].len = mbox_dequeue(msg_vec[i].msg, mbox_num);
+	}
+
+	return i;
+}
+
+// Helper function for the dequeuing for the messages for a given mailbox
+// The oldest message of the highest priority band is taken and its space
+// is reclaimed right away (see mbox_ring_remove).
+// Returns the length of the message data, -1 if the mailbox is empty
+int mbox_dequeue(msg_t *msg, int mbox_num)
+{
+	mailbox_t *mb;
+	mbox_rec_t rec;
+	int prio;
+	int off;
+
+	if (msg == NULL)
+	{
+		panic("Message: INVALID"); // error checking
+	}
+
+	
+	mb = mbox_get(mbox_num); // easy pointer, created on first use
+
+	if (mb->size == 0)
+	{
+		return -1; // if empty
+	}
+
+	for (prio = MSG_PRIO_HIGH; !(mb->band_bitmap & (1 << prio)); prio++);
+	
+	off = mb->band_head[prio];
+	mbox_ring_get(mb, off, &rec, sizeof(mbox_rec_t));								// record header
+	mbox_ring_get(mb, (off + sizeof(mbox_rec_t)) % MBOX_BYTES, msg->data, rec.len);	// From mailbox to process
+	mbox_record_delay(prio, (unsigned int)ktimer_rdtsc() - rec.tsc);
+
+	// unlink from the band and give its space back
+	mb->band_head[prio] = rec.next;
+	if (rec.next == -1)
+	{
+		mb->band_tail[prio] = -1;
+		mb->band_bitmap &= ~(1 << prio);
+	}
+	mbox_ring_remove(mb, off, sizeof(mbox_rec_t) + rec.len);
+	
+	mb->size--; 			// reduce size of Q
+	msg->sender = rec.sender;
+	msg->time_sent = rec.time_sent;
+	msg->time_received = (int)(system_time / CLK_TCK);	//system time / clock tick
+	return rec.len; // it worked
+}
+
+// Helper function that records how long a message of a priority band was queued
+static void mbox_record_delay(int prio, unsigned int cycles)
+{
+	msg_prio_stats[prio].msgs++;
+	msg_prio_stats[prio].delay_total += cycles;
+	if (cycles > msg_prio_stats[prio].delay_max)
+	{
+		msg_prio_stats[prio].delay_max = cycles;
+	}
+}
+
+// Function to display the queueing delay of each message priority band
+void mbox_print_stats()
+{
+	int prio;
+
+	for (prio = MSG_PRIO_HIGH; prio < MSG_PRIO_LEVELS; prio++)
+	{
+		if (msg_prio_stats[prio].msgs > 0)
+		{
+			printf("msg prio %d: msgs=%u delay avg=%u max=%u us\n", prio, msg_prio_stats[prio].msgs,
+				   ktimer_cycles_to_us(msg_prio_stats[prio].delay_total / msg_prio_stats[prio].msgs),
+				   ktimer_cycles_to_us(msg_prio_stats[prio].delay_max));
+		}
+	}
+}
@@ -8,20 +8,61 @@
 #ifndef KSYSCALL_H
 #define KSYSCALL_H
 
-void ksyscall_get_sys_time();                                       // system information
+void ksyscall_get_time_ns();                                        // system information
 
 /* Process information */
 void ksyscall_get_proc_pid();
 void ksyscall_get_proc_name();
 
+/* Process creation */
+void ksyscall_proc_fork();
+
 // kernel system calls for data passing
 void ksyscall_sem_init();
 void ksyscall_sem_wait();
 void ksyscall_sem_post();
+void ksyscall_sem_trywait();
+void ksyscall_sem_timedwait();
+void ksyscall_sem_destroy();
+void ksyscall_ring_attach();
+void ksyscall_shm_create();
+void ksyscall_shm_attach();
+void ksyscall_shm_detach();
+void ksyscall_futex_wait();
+void ksyscall_futex_wake();
+void ksyscall_mutex_init();
+void ksyscall_mutex_lock();
+void ksyscall_mutex_unlock();
+void ksyscall_cond_init();
+void ksyscall_cond_wait();
+void ksyscall_cond_signal();
+void ksyscall_cond_broadcast();
+void ksyscall_rwlock_init();
+void ksyscall_rwlock_rdlock();
+void ksyscall_rwlock_wrlock();
+void ksyscall_rwlock_unlock();
 void ksyscall_msg_send();
+void ksyscall_msg_send_prio();
 void ksyscall_msg_recv();
+void ksyscall_msg_sendv();
+void ksyscall_msg_recvv();
+void ksyscall_msg_trysend();
+void ksyscall_msg_recv_timeout();
+void ksyscall_msg_tryrecv();
+void ksyscall_msg_select();
+void ksyscall_topic_subscribe();
+void ksyscall_topic_unsubscribe();
+void ksyscall_topic_publish();
+void ksyscall_topic_recv();
 
 /* Additional functionality */
-void ksyscall_sleep();                                        
+void ksyscall_sleep_ms();
+void ksyscall_sleep_us();
+
+// Process exit
+void shm_exit(int pid);
+
+// Statistics
+void mbox_print_stats();
 
 #endif
\ No newline at end of file
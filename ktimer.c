@@ -0,0 +1,305 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Timers
+ *
+ * Sleeping processes are kept in a doubly linked list ordered by wake
+ * time, threaded through the PCBs. Each timer tick only looks at the head
+ * of the list, so the cost of a tick depends on how many processes are
+ * due rather than how many are asleep.
+ *
+ * The time stamp counter is calibrated against the PIT at boot and
+ * provides a nanosecond resolution monotonic clock.
+ *
+ * When only the idle task can run, the PIT is switched to one-shot mode
+ * so the CPU is not interrupted until the next process has to wake up.
+ */
+#include "spede.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "ktimer.h"
+#include "kqueue.h"
+
+/**
+ * Calibrates the time stamp counter against PIT channel 2
+ * Channel 2 counts down TSC_CALIBRATE_MS worth of PIT clocks while the
+ * number of elapsed CPU cycles is measured.
+ */
+void ktimer_init() {
+
+    unsigned int count = PIT_FREQ / 1000 * TSC_CALIBRATE_MS;
+    unsigned long long start;
+
+    // Enable the channel 2 gate, keep the speaker off
+    outportb(PIT_CH2_GATE, (inportb(PIT_CH2_GATE) & ~0x02) | 0x01);
+
+    outportb(PIT_CMD, PIT_MODE_CH2_ONESHOT);
+    outportb(PIT_CH2, count & 0xFF);
+    outportb(PIT_CH2, (count >> 8) & 0xFF);
+
+    start = ktimer_rdtsc();
+    while ((inportb(PIT_CH2_GATE) & 0x20) == 0) {
+        // wait for the channel 2 output to go high
+    }
+
+    tsc_khz = (unsigned int)(ktimer_rdtsc() - start) / TSC_CALIBRATE_MS;
+    tsc_boot = ktimer_rdtsc();
+
+    if (tsc_khz == 0) {
+        panic("Unable to calibrate the time stamp counter");
+    }
+
+    printf("TSC calibrated at %u kHz\n", tsc_khz);
+
+}
+
+/**
+ * Obtains the time since boot from the time stamp counter
+ * @return time in nanoseconds
+ */
+unsigned long long ktimer_now_ns() {
+
+    unsigned long long cycles = ktimer_rdtsc() - tsc_boot;
+    unsigned long long ms = cycles / tsc_khz;
+
+    // Split at millisecond boundaries so the multiplication cannot overflow
+    return ms * 1000000 + (cycles - ms * tsc_khz) * 1000000 / tsc_khz;
+
+}
+
+/**
+ * Adds a process to the sleep list
+ * Processes with the same wake time are woken in the order they were added
+ * @param pid       the process to put to sleep
+ * @param wake_time system time (ticks) when the process should wake up
+ */
+void ktimer_add(int pid, tick_t wake_time) {
+
+    int prev = -1;
+    int next = sleep_head;
+
+    if (pid < 0 || pid > PID_MAX) {
+        panic("Invalid PID");
+    }
+
+    // Find the first sleeper that wakes up later than this process
+    while (next != -1 && pcb[next]->wake_time <= wake_time) {
+        prev = next;
+        next = pcb[next]->sleep_next;
+    }
+
+    pcb[pid]->wake_time = wake_time;
+    pcb[pid]->sleep_prev = prev;
+    pcb[pid]->sleep_next = next;
+
+    if (prev == -1) {
+        sleep_head = pid;
+    } else {
+        pcb[prev]->sleep_next = pid;
+    }
+
+    if (next != -1) {
+        pcb[next]->sleep_prev = pid;
+    }
+
+    sleep_count++;
+
+}
+
+/**
+ * Removes a process from the sleep list
+ * @param pid   the process to remove; must be on the sleep list
+ */
+void ktimer_remove(int pid) {
+
+    int prev = pcb[pid]->sleep_prev;
+    int next = pcb[pid]->sleep_next;
+
+    if (prev == -1) {
+        sleep_head = next;
+    } else {
+        pcb[prev]->sleep_next = next;
+    }
+
+    if (next != -1) {
+        pcb[next]->sleep_prev = prev;
+    }
+
+    pcb[pid]->sleep_prev = -1;
+    pcb[pid]->sleep_next = -1;
+    sleep_count--;
+
+}
+
+/**
+ * Wakes up every process whose wake time has been reached
+ * A process in a timed wait is taken off its wait queue and its system
+ * call returns IPC_TIMEOUT.
+ */
+void ktimer_expire() {
+
+    int pid;
+
+    while (sleep_head != -1 && pcb[sleep_head]->wake_time <= system_time) {
+        pid = sleep_head;
+        ktimer_remove(pid);
+
+        if (pcb[pid]->state == WAITING) {
+            kqueue_remove(pid);                                     // leaves its wait queue, if any
+            if (pcb[pid]->timeout_fn != NULL) {
+                pcb[pid]->timeout_fn(pid);                          // leaves any select queues
+            }
+            pcb[pid]->timeout_fn = NULL;
+            pcb[pid]->trapframe_p->edx = IPC_TIMEOUT;
+        }
+
+        kproc_wake(pid);                                            // may preempt the running process
+    }
+
+}
+
+/**
+ * Limits how long a process waits on a wait queue
+ * The caller still adds the process to the wait queue, which it leaves when
+ * the wait times out. A process waiting on select queues sets its
+ * timeout_fn to leave them.
+ * @param pid       the process about to wait
+ * @param ticks     number of timer ticks before the wait times out
+ */
+void ktimer_timeout(int pid, tick_t ticks) {
+
+    ktimer_add(pid, system_time + ticks);
+
+}
+
+/**
+ * Cancels the timeout of a process whose wait ended normally
+ * @param pid   the process that was woken up
+ */
+void ktimer_cancel(int pid) {
+
+    if (sleep_head == pid || pcb[pid]->sleep_prev != -1) {         // still on the sleep list
+        ktimer_remove(pid);
+    }
+    pcb[pid]->timeout_fn = NULL;
+
+}
+
+/**
+ * Converts time stamp counter cycles to microseconds
+ * @param  cycles - number of CPU cycles
+ * @return number of microseconds
+ */
+unsigned int ktimer_cycles_to_us(unsigned long long cycles) {
+
+    return tsc_khz ? (unsigned int)(cycles * 1000 / tsc_khz) : 0;
+
+}
+
+/**
+ * Converts milliseconds to timer ticks, rounding up
+ * @param  ms - number of milliseconds
+ * @return number of timer ticks
+ */
+tick_t ktimer_ms_to_ticks(unsigned int ms) {
+
+    return ((tick_t)ms * CLK_TCK + 999) / 1000;
+
+}
+
+/**
+ * Stops the periodic timer tick while the idle task runs
+ * The PIT is programmed to interrupt once when the first sleeper is due,
+ * limited by the range of its 16-bit counter.
+ */
+void ktimer_tickless_enter() {
+
+    int ticks = PIT_TICKS_MAX;
+    unsigned int count;
+
+    // Only skip ticks when nothing but the idle task is ready to run
+    if (!tickless || prio_bitmap != 0 || tickless_ticks != 0) {
+        return;
+    }
+
+    if (sleep_head != -1 && pcb[sleep_head]->wake_time - system_time < ticks) {
+        ticks = (int)(pcb[sleep_head]->wake_time - system_time);
+    }
+
+    // Not worth reprogramming the PIT for a single tick
+    if (ticks <= 1) {
+        return;
+    }
+
+    count = ticks * PIT_DIVISOR;
+    outportb(PIT_CMD, PIT_MODE_ONESHOT);
+    outportb(PIT_CH0, count & 0xFF);
+    outportb(PIT_CH0, (count >> 8) & 0xFF);
+
+    tickless_ticks = ticks;
+
+}
+
+/**
+ * Restores the periodic timer tick after a one-shot timer interrupt
+ * @return number of ticks that have elapsed since the previous interrupt
+ */
+int ktimer_tickless_exit() {
+
+    int ticks = tickless_ticks;
+
+    if (ticks == 0) {
+        return 1;                                               // Regular periodic tick
+    }
+
+    outportb(PIT_CMD, PIT_MODE_PERIODIC);
+    outportb(PIT_CH0, PIT_DIVISOR & 0xFF);
+    outportb(PIT_CH0, (PIT_DIVISOR >> 8) & 0xFF);
+
+    tickless_ticks = 0;
+    ticks_skipped += ticks - 1;                                 // Interrupts that never had to happen
+
+    return ticks;
+
+}
+
+/**
+ * Records the cost of one timer interrupt
+ * @param cycles    CPU cycles spent handling the interrupt
+ */
+void ktimer_record(unsigned int cycles) {
+
+    int n = sleep_count;
+
+    if (n < 0 || n > PROC_MAX) {
+        return;
+    }
+
+    timer_stats.ticks[n]++;
+    timer_stats.cycles[n] += cycles;
+    if (cycles > timer_stats.cycles_max[n]) {
+        timer_stats.cycles_max[n] = cycles;
+    }
+
+}
+
+/**
+ * Displays the timer interrupt cost, grouped by the number of sleeping
+ * processes, on the host console
+ */
+void ktimer_print_stats() {
+
+    int n;
+
+    printf("timer: tickless=%s ticks skipped=%u\n", tickless ? "on" : "off", ticks_skipped);
+
+    for (n = 0; n <= PROC_MAX; n++) {
+        if (timer_stats.ticks[n] > 0) {
+            printf("timer: sleepers=%d ticks=%u cycles avg=%u max=%u\n", n, timer_stats.ticks[n],
+                   timer_stats.cycles[n] / timer_stats.ticks[n], timer_stats.cycles_max[n]);
+        }
+    }
+
+}
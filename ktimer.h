@@ -0,0 +1,69 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Timers
+ */
+#ifndef KTIMER_H
+#define KTIMER_H
+
+#include "kernel.h"
+
+// 8253/8254 Programmable Interval Timer
+#define PIT_FREQ 1193182                                    // PIT input clock (Hz)
+#define PIT_CH0 0x40                                        // Channel 0 data port (IRQ 0)
+#define PIT_CMD 0x43                                        // Mode/command port
+#define PIT_MODE_ONESHOT 0x30                               // Channel 0, lo/hi byte, mode 0 (interrupt on terminal count)
+#define PIT_MODE_PERIODIC 0x34                              // Channel 0, lo/hi byte, mode 2 (rate generator)
+#define PIT_DIVISOR (PIT_FREQ / CLK_TCK)                    // PIT count for one system tick
+#define PIT_TICKS_MAX (0xFFFF / PIT_DIVISOR)                // Longest one-shot delay (ticks) the 16-bit counter allows
+#define PIT_CH2 0x42                                        // Channel 2 data port (speaker, gated by port 0x61)
+#define PIT_CH2_GATE 0x61                                   // Channel 2 gate/output control port
+#define PIT_MODE_CH2_ONESHOT 0xB0                           // Channel 2, lo/hi byte, mode 0
+#define TSC_CALIBRATE_MS 10                                 // Length of the TSC calibration window
+
+/**
+ * Reads the CPU time stamp counter
+ * @return number of CPU cycles since reset
+ */
+static inline unsigned long long ktimer_rdtsc() {
+    unsigned long long tsc;
+
+    asm volatile("rdtsc" : "=A"(tsc));
+    return tsc;
+}
+
+/**
+ * Reads the low 32 bits of the CPU time stamp counter
+ * @return number of CPU cycles (wraps around)
+ */
+static inline unsigned int ktimer_cycles() {
+    unsigned int lo;
+
+    asm volatile("rdtsc" : "=a"(lo) : : "edx");
+    return lo;
+}
+
+// Clock functions
+void ktimer_init();
+unsigned long long ktimer_now_ns();
+
+// Sleep list functions
+void ktimer_add(int pid, tick_t wake_time);
+void ktimer_remove(int pid);
+void ktimer_expire();
+void ktimer_timeout(int pid, tick_t ticks);
+void ktimer_cancel(int pid);
+tick_t ktimer_ms_to_ticks(unsigned int ms);
+unsigned int ktimer_cycles_to_us(unsigned long long cycles);
+
+// Tickless idle
+void ktimer_tickless_enter();
+int ktimer_tickless_exit();
+
+// Timer statistics
+void ktimer_record(unsigned int cycles);
+void ktimer_print_stats();
+
+#endif
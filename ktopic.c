@@ -0,0 +1,236 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Publish/Subscribe Topics
+ *
+ * A published message is copied once into a shared buffer. Each subscriber
+ * queue only holds the buffer number, and the buffer counts the subscribers
+ * that still have to consume it. It is freed when the last one does.
+ */
+#include "spede.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kqueue.h"
+#include "string.h"
+#include "ktimer.h"
+#include "ktopic.h"
+
+/**
+ * Finds the subscription of a process to a topic
+ * @param  topic_num - the topic
+ * @param  pid       - the process, or -1 to find a free slot
+ * @return subscription slot, -1 if there is none
+ */
+static int ktopic_find(int topic_num, int pid) {
+
+    int i;
+
+    for (i = 0; i < TOPIC_SUBS; i++) {
+        if (topics[topic_num].sub[i].pid == pid) {
+            return i;
+        }
+    }
+
+    return -1;
+
+}
+
+/**
+ * Drops one reference to a message buffer, freeing it with the last one
+ * @param buf_num - the buffer
+ */
+static void ktopic_release(int buf_num) {
+
+    if (--topic_bufs[buf_num].refs == 0) {
+        topic_bufs[buf_num].next = topic_free;
+        topic_free = buf_num;
+    }
+
+}
+
+/**
+ * Subscribes a process to a topic
+ * @param  pid       - the process
+ * @param  topic_num - the topic
+ * @return 0 on success, -1 if the topic has no free subscription slot
+ */
+int ktopic_subscribe(int pid, int topic_num) {
+
+    int slot;
+
+    if (ktopic_find(topic_num, pid) != -1) {
+        return 0;                                                   // already subscribed
+    }
+
+    slot = ktopic_find(topic_num, -1);
+    if (slot == -1) {
+        return -1;
+    }
+
+    sp_memset(&topics[topic_num].sub[slot], 0, sizeof(topic_sub_t));
+    topics[topic_num].sub[slot].pid = pid;
+    topics[topic_num].subs++;
+    return 0;
+
+}
+
+/**
+ * Unsubscribes a process from a topic, dropping the messages it had not
+ * consumed yet
+ * @param pid       the process
+ * @param topic_num the topic
+ */
+void ktopic_unsubscribe(int pid, int topic_num) {
+
+    int slot = ktopic_find(topic_num, pid);
+    topic_sub_t *sub;
+
+    if (slot == -1) {
+        return;
+    }
+
+    sub = &topics[topic_num].sub[slot];
+    while (sub->size > 0) {
+        ktopic_release(sub->bufs[sub->head]);
+        sub->head = (sub->head + 1) % TOPIC_DEPTH;
+        sub->size--;
+    }
+
+    sub->pid = -1;
+    topics[topic_num].subs--;
+
+}
+
+/**
+ * Publishes a message to every subscriber of a topic
+ * The message is copied once; each subscriber only gets the buffer number.
+ * Subscribers waiting in ktopic_recv are handed their copy and woken.
+ * @param  pid       - the publishing process
+ * @param  topic_num - the topic
+ * @param  msg       - the message
+ * @param  len       - number of data bytes in the message
+ * @return MSG_OK, or MSG_ERR_FULL if there is no free buffer or a
+ *         subscriber has too many messages queued
+ */
+int ktopic_publish(int pid, int topic_num, msg_t *msg, int len) {
+
+    int i, buf_num, waiting_pid;
+    topic_t *topic = &topics[topic_num];
+    topic_sub_t *sub;
+
+    if (topic->subs == 0) {
+        return MSG_OK;                                              // nobody to deliver to
+    }
+
+    if (topic_free == -1) {
+        topic->dropped++;
+        return MSG_ERR_FULL;
+    }
+
+    for (i = 0; i < TOPIC_SUBS; i++) {
+        if (topic->sub[i].pid != -1 && topic->sub[i].size == TOPIC_DEPTH) {
+            topic->dropped++;
+            return MSG_ERR_FULL;
+        }
+    }
+
+    // one copy into a shared buffer
+    buf_num = topic_free;
+    topic_free = topic_bufs[buf_num].next;
+    topic_bufs[buf_num].refs = topic->subs;
+    topic_bufs[buf_num].sender = pid;
+    topic_bufs[buf_num].time_sent = (int)(system_time / CLK_TCK);
+    topic_bufs[buf_num].len = len;
+    sp_memcpy(topic_bufs[buf_num].data, msg->data, len);
+
+    // one buffer number per subscriber
+    for (i = 0; i < TOPIC_SUBS; i++) {
+        sub = &topic->sub[i];
+        if (sub->pid != -1) {
+            sub->bufs[(sub->head + sub->size) % TOPIC_DEPTH] = buf_num;
+            sub->size++;
+        }
+    }
+    topic->published++;
+
+    // every waiting subscriber now has a message
+    while (kqueue_pop(&topic->wait_q, &waiting_pid) == 0) {
+        pcb[waiting_pid]->trapframe_p->edx =
+            ktopic_recv(waiting_pid, topic_num, (msg_t *)pcb[waiting_pid]->trapframe_p->ebx);
+        kproc_wake(waiting_pid);
+    }
+
+    return MSG_OK;
+
+}
+
+/**
+ * Consumes the next message a subscriber has queued on a topic
+ * @param  pid       - the subscribed process
+ * @param  topic_num - the topic
+ * @param  msg       - where to copy the message
+ * @return number of data bytes received, -1 if no message is queued
+ */
+int ktopic_recv(int pid, int topic_num, msg_t *msg) {
+
+    int slot = ktopic_find(topic_num, pid);
+    int buf_num, len;
+    topic_sub_t *sub;
+
+    if (slot == -1) {
+        panic("Process is not subscribed to the topic");
+    }
+
+    sub = &topics[topic_num].sub[slot];
+    if (sub->size == 0) {
+        return -1;
+    }
+
+    buf_num = sub->bufs[sub->head];
+    sub->head = (sub->head + 1) % TOPIC_DEPTH;
+    sub->size--;
+
+    len = topic_bufs[buf_num].len;
+    msg->sender = topic_bufs[buf_num].sender;
+    msg->time_sent = topic_bufs[buf_num].time_sent;
+    msg->time_received = (int)(system_time / CLK_TCK);
+    sp_memcpy(msg->data, topic_bufs[buf_num].data, len);
+
+    ktopic_release(buf_num);
+    return len;
+
+}
+
+/**
+ * Unsubscribes an exiting process from every topic, so its queues do not
+ * fill up and block publishers, and a process that reuses its PID does
+ * not inherit the subscriptions
+ * @param pid - the process
+ */
+void ktopic_exit(int pid) {
+
+    int i;
+
+    for (i = 0; i < TOPIC_MAX; i++) {
+        ktopic_unsubscribe(pid, i);
+    }
+
+}
+
+/**
+ * Displays how many messages each topic carried
+ */
+void ktopic_print_stats() {
+
+    int i;
+
+    for (i = 0; i < TOPIC_MAX; i++) {
+        if (topics[i].published > 0 || topics[i].subs > 0) {
+            printf("topic %d: subscribers=%d published=%u dropped=%u\n",
+                   i, topics[i].subs, topics[i].published, topics[i].dropped);
+        }
+    }
+
+}
@@ -0,0 +1,21 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Publish/Subscribe Topics
+ */
+#ifndef KTOPIC_H
+#define KTOPIC_H
+
+#include "kernel.h"
+#include "ipc.h"
+
+int ktopic_subscribe(int pid, int topic_num);
+void ktopic_unsubscribe(int pid, int topic_num);
+int ktopic_publish(int pid, int topic_num, msg_t *msg, int len);
+int ktopic_recv(int pid, int topic_num, msg_t *msg);
+void ktopic_exit(int pid);
+void ktopic_print_stats();
+
+#endif
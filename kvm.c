@@ -0,0 +1,426 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Virtual Memory
+ *
+ * The kernel runs on kvm_kernel_pd, which identity maps the first 16 MB
+ * (kernel image, video memory and the whole page pool); every interrupt
+ * entry switches to it, so kernel pointers mean the same thing they did
+ * before paging.
+ *
+ * Each process gets its own page directory. It shares the kernel's
+ * identity page tables except for those covering the page pool, which
+ * are private copies mapping only the process' own stack and the shared
+ * memory segments it has attached; a stray write to another process'
+ * stack now faults. The stack is mapped up front because the CPU pushes
+ * the interrupt frame onto it. The table holding the shared kernel
+ * information page (vdso) is a private copy as well, mapping that page
+ * read-only: only the kernel updates it, on its own page directory.
+ *
+ * On top of that each process has a private data window at
+ * PROC_DATA_BASE. Its pages are allocated on first touch, and proc_fork
+ * shares them read-only with the new process, copying a page only when
+ * one side writes to it. kvm_kernel_pd has no data window mapping, so the
+ * kernel never sees any process' data window: system call arguments
+ * (messages, semaphore IDs and the like) must be kept on the stack, in
+ * static data or in shared memory. kisr_syscall() kills a process that
+ * passes a pointer into the window before the call changes any state.
+ */
+#include "spede.h"
+#include "kernel.h"
+#include "kisr.h"
+#include "kpage.h"
+#include "kproc.h"
+#include "string.h"
+#include "vdso.h"
+#include "kvm.h"
+
+/**
+ * Returns the page allocator page number of an address in kpages[]
+ * @param  addr - address of the page
+ * @return page number
+ */
+static inline int kvm_page_num(unsigned int addr) {
+
+    return ((unsigned char *)addr - kpages[0]) / KPAGE_SIZE;
+
+}
+
+/**
+ * Checks whether an address lies in the page pool
+ * @param  addr - address
+ * @return non-zero if it does
+ */
+static inline int kvm_in_pool(unsigned int addr) {
+
+    return addr >= (unsigned int)kpages[0] && addr < (unsigned int)kpages[KPAGE_COUNT];
+
+}
+
+/**
+ * Checks whether a process gets a private copy of an identity page table:
+ * those covering the page pool or the shared kernel information page
+ * @param  i - page directory index
+ * @return non-zero if it does
+ */
+static int kvm_private_pt(int i) {
+
+    return (i >= (int)KVM_PDE(kpages[0]) && i <= (int)KVM_PDE(kpages[KPAGE_COUNT - 1])) ||
+           i == (int)KVM_PDE(&vdso);
+
+}
+
+/**
+ * Allocates a cleared page directory or page table
+ * @return address of the table, NULL if there is no memory left
+ */
+static unsigned int *kvm_table_alloc() {
+
+    unsigned int *table = kpage_alloc(1);
+
+    if (table != NULL) {
+        sp_memset(table, 0, KPAGE_SIZE);
+    }
+
+    return table;
+
+}
+
+/**
+ * Returns the page table of a process' data window
+ * @param  pid - process ID
+ * @return page table, NULL if the process has not touched the window yet
+ */
+static unsigned int *kvm_data_table(int pid) {
+
+    unsigned int pde = pcb[pid]->page_dir[KVM_PDE(PROC_DATA_BASE)];
+
+    return (pde & KVM_PRESENT) ? (unsigned int *)(pde & KVM_FRAME) : NULL;
+
+}
+
+/**
+ * Drops one reference to a data page, freeing it with the last one
+ * @param addr - address of the page
+ */
+static void kvm_page_put(unsigned int addr) {
+
+    if (--kpage_refs[kvm_page_num(addr)] == 0) {
+        kpage_free((void *)addr, 1);
+    }
+
+}
+
+/**
+ * Sets the page table entries of the page pool pages in a process'
+ * address space
+ * @param pid   - process ID
+ * @param addr  - address of the first page (in kpages[])
+ * @param count - number of pages
+ * @param flags - entry flags, 0 to unmap the pages
+ */
+static void kvm_set(int pid, void *addr, int count, unsigned int flags) {
+
+    unsigned int page = (unsigned int)addr;
+    unsigned int *pt;
+
+    for (; count > 0; count--, page += KPAGE_SIZE) {
+        if (!kvm_in_pool(page)) {
+            panic("Invalid page address");
+        }
+
+        pt = (unsigned int *)(pcb[pid]->page_dir[KVM_PDE(page)] & KVM_FRAME);
+        pt[KVM_PTE(page)] = flags ? page | flags : 0;
+    }
+
+}
+
+/**
+ * Builds the kernel page directory and turns on paging
+ */
+void kvm_init() {
+
+    int i;
+
+    if ((unsigned int)kpages[KPAGE_COUNT] > KVM_IDENT_PTS * KVM_ENTRIES * KPAGE_SIZE) {
+        panic("Page pool lies outside the identity map");
+    }
+
+    if (KVM_PDE(PROC_DATA_BASE) < KVM_IDENT_PTS) {
+        panic("Data window overlaps the identity map");
+    }
+
+    sp_memset(kvm_kernel_pd, 0, sizeof(kvm_kernel_pd));
+
+    for (i = 0; i < KVM_IDENT_PTS * KVM_ENTRIES; i++) {
+        kvm_ident_pt[i / KVM_ENTRIES][i % KVM_ENTRIES] = i * KPAGE_SIZE | KVM_PRESENT | KVM_WRITE;
+    }
+
+    for (i = 0; i < KVM_IDENT_PTS; i++) {
+        kvm_kernel_pd[i] = (unsigned int)kvm_ident_pt[i] | KVM_PRESENT | KVM_WRITE;
+    }
+
+    set_cr3((unsigned int)kvm_kernel_pd);
+    set_cr0(get_cr0() | KVM_CR0_PG | KVM_CR0_WP);     // WP so copy-on-write pages fault even in ring 0
+
+}
+
+/**
+ * Creates the address space of a new process and maps its stack
+ * @param  pid - process ID (the PCB and stack must already be set up)
+ * @return 0 on success, -1 if there is no memory left
+ */
+int kvm_create(int pid) {
+
+    int i, j;
+    unsigned int *pt;
+
+    if ((pcb[pid]->page_dir = kvm_table_alloc()) == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < KVM_IDENT_PTS; i++) {
+        if (!kvm_private_pt(i)) {
+            pcb[pid]->page_dir[i] = kvm_kernel_pd[i];
+            continue;
+        }
+
+        // Private copy of the identity map with the page pool left out and the vdso read-only
+        if ((pt = kpage_alloc(1)) == NULL) {
+            kvm_destroy(pid);
+            return -1;
+        }
+
+        for (j = 0; j < KVM_ENTRIES; j++) {
+            pt[j] = kvm_in_pool(kvm_ident_pt[i][j] & KVM_FRAME) ? 0 : kvm_ident_pt[i][j];
+        }
+        if (i == (int)KVM_PDE(&vdso)) {
+            pt[KVM_PTE(&vdso)] &= ~KVM_WRITE;
+        }
+
+        pcb[pid]->page_dir[i] = (unsigned int)pt | KVM_PRESENT | KVM_WRITE;
+    }
+
+    kvm_map(pid, pcb[pid]->stack, pcb[pid]->stack_pages);
+    return 0;
+
+}
+
+/**
+ * Frees the address space of a process and its data pages
+ * Must not be called for the address space currently loaded in CR3.
+ * @param pid - process ID
+ */
+void kvm_destroy(int pid) {
+
+    int i;
+    unsigned int *pd = pcb[pid]->page_dir;
+    unsigned int *pt;
+
+    if (pd == NULL) {
+        return;
+    }
+
+    if ((pt = kvm_data_table(pid)) != NULL) {
+        for (i = 0; i < KVM_ENTRIES; i++) {
+            if (pt[i] & KVM_PRESENT) {
+                kvm_page_put(pt[i] & KVM_FRAME);
+            }
+        }
+        kpage_free(pt, 1);
+    }
+
+    // Private identity page tables
+    for (i = 0; i < KVM_IDENT_PTS; i++) {
+        if (kvm_private_pt(i) && (pd[i] & KVM_PRESENT)) {
+            kpage_free((void *)(pd[i] & KVM_FRAME), 1);
+        }
+    }
+
+    kpage_free(pd, 1);
+    pcb[pid]->page_dir = NULL;
+
+}
+
+/**
+ * Maps page pool pages (a shared memory segment) into a process
+ * @param pid   - process ID
+ * @param addr  - address of the first page
+ * @param count - number of pages
+ */
+void kvm_map(int pid, void *addr, int count) {
+
+    kvm_set(pid, addr, count, KVM_PRESENT | KVM_WRITE);
+
+}
+
+/**
+ * Unmaps page pool pages from a process
+ * @param pid   - process ID
+ * @param addr  - address of the first page
+ * @param count - number of pages
+ */
+void kvm_unmap(int pid, void *addr, int count) {
+
+    kvm_set(pid, addr, count, 0);
+
+}
+
+/**
+ * Shares the data window of a process with a new process copy-on-write
+ * Only the page table is copied; both sides lose write access to the
+ * pages until they fault and get their own copy.
+ * @param  parent - process whose data window is shared
+ * @param  child  - new process (with an empty data window)
+ * @return 0 on success, -1 if there is no memory left
+ */
+int kvm_fork(int parent, int child) {
+
+    int i;
+    unsigned int *from, *to;
+
+    kvm_stats.forks++;
+
+    if ((from = kvm_data_table(parent)) == NULL) {
+        return 0;
+    }
+
+    if ((to = kvm_table_alloc()) == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < KVM_ENTRIES; i++) {
+        if (from[i] & KVM_PRESENT) {
+            from[i] = (from[i] & ~KVM_WRITE) | KVM_COW;
+            to[i] = from[i];
+            kpage_refs[kvm_page_num(from[i] & KVM_FRAME)]++;
+            kvm_stats.shared++;
+        }
+    }
+
+    pcb[child]->page_dir[KVM_PDE(PROC_DATA_BASE)] = (unsigned int)to | KVM_PRESENT | KVM_WRITE;
+    return 0;
+
+}
+
+/**
+ * Resolves a page fault in the data window of a process
+ * @param  pid   - process ID
+ * @param  addr  - faulting address
+ * @param  error - page fault error code
+ * @return 0 if the page is now mapped, -1 if the access is invalid or
+ *         there is no memory left
+ */
+static int kvm_resolve(int pid, unsigned int addr, unsigned int error) {
+
+    unsigned int *pt, *pte;
+    unsigned int frame;
+    unsigned char *page;
+
+    if (addr < PROC_DATA_BASE || addr >= PROC_DATA_BASE + PROC_DATA_SIZE) {
+        return -1;
+    }
+
+    // First touch of the window: give it a page table
+    if ((pt = kvm_data_table(pid)) == NULL) {
+        if ((pt = kvm_table_alloc()) == NULL) {
+            return -1;
+        }
+        pcb[pid]->page_dir[KVM_PDE(addr)] = (unsigned int)pt | KVM_PRESENT | KVM_WRITE;
+    }
+
+    pte = &pt[KVM_PTE(addr)];
+
+    // First touch of the page: fill it with zeros
+    if (!(*pte & KVM_PRESENT)) {
+        if ((page = kpage_alloc(1)) == NULL) {
+            return -1;
+        }
+        sp_memset(page, 0, KPAGE_SIZE);
+        kpage_refs[kvm_page_num((unsigned int)page)] = 1;
+        *pte = (unsigned int)page | KVM_PRESENT | KVM_WRITE;
+        kvm_stats.zero_fills++;
+        return 0;
+    }
+
+    if (!(error & KVM_FAULT_WRITE) || !(*pte & KVM_COW)) {
+        return -1;
+    }
+
+    // Write to a shared page: the last sharer takes it over, anyone else copies it
+    frame = *pte & KVM_FRAME;
+    if (kpage_refs[kvm_page_num(frame)] == 1) {
+        *pte = frame | KVM_PRESENT | KVM_WRITE;
+        kvm_stats.cow_reuses++;
+        return 0;
+    }
+
+    if ((page = kpage_alloc(1)) == NULL) {
+        return -1;
+    }
+    sp_memcpy(page, (void *)frame, KPAGE_SIZE);
+    kpage_refs[kvm_page_num(frame)]--;
+    kpage_refs[kvm_page_num((unsigned int)page)] = 1;
+    *pte = (unsigned int)page | KVM_PRESENT | KVM_WRITE;
+    kvm_stats.cow_copies++;
+    return 0;
+
+}
+
+/**
+ * Kernel Interrupt Service Routine: Page fault
+ * Maps data window pages on demand and kills processes that touch memory
+ * they do not own. A fault in the kernel itself is fatal: system call
+ * arguments are checked with kvm_user_ok() before the kernel touches them.
+ * @param trapframe - trapframe of the faulting context
+ */
+void kvm_fault(trapframe_t *trapframe) {
+
+    unsigned int addr = get_cr2();
+
+    if ((char *)trapframe >= kstack && (char *)trapframe < kstack + KSTACK_SIZE) {
+        printf("Kernel page fault at 0x%x (eip=0x%x, error=0x%x)\n", addr, trapframe->eip, kvm_fault_code);
+        panic("Kernel page fault");
+    }
+
+    if (kvm_resolve(run_pid, addr, kvm_fault_code) == 0) {
+        return;
+    }
+
+    printf("Process %s (pid=%d) killed: page fault at 0x%x (eip=0x%x, error=0x%x)\n",
+           pcb[run_pid]->name, run_pid, addr, trapframe->eip, kvm_fault_code);
+
+    if (run_pid == 0) {
+        panic("Page fault in the idle task");
+    }
+
+    kvm_stats.killed++;
+    kproc_exit();
+
+}
+
+/**
+ * Checks that memory a system call argument points to stays out of the
+ * data window, which the kernel cannot see
+ * @param  addr - address of the argument
+ * @param  len  - size of the argument in bytes
+ * @return non-zero if the kernel can access it
+ */
+int kvm_user_ok(unsigned int addr, unsigned int len) {
+
+    return addr + len <= PROC_DATA_BASE || addr >= PROC_DATA_BASE + PROC_DATA_SIZE;
+
+}
+
+/**
+ * Displays paging statistics on the host console
+ */
+void kvm_print_stats() {
+
+    printf("paging: zero fills=%u cow copies=%u cow reuses=%u forks=%u pages shared=%u killed=%u\n",
+           kvm_stats.zero_fills, kvm_stats.cow_copies, kvm_stats.cow_reuses,
+           kvm_stats.forks, kvm_stats.shared, kvm_stats.killed);
+
+}
@@ -0,0 +1,45 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Kernel Virtual Memory
+ */
+#ifndef KVM_H
+#define KVM_H
+
+#include "spede.h"
+#include "kernel.h"
+#include "trapframe.h"
+
+// Page directory and page table entries
+#define KVM_PRESENT 0x001                                   // Page is mapped
+#define KVM_WRITE 0x002                                     // Page is writable
+#define KVM_COW 0x200                                       // Page is shared by proc_fork; copy it on a write (bit free for the OS)
+#define KVM_FRAME 0xFFFFF000                                // Address of the page or page table
+#define KVM_PDE(addr) ((unsigned int)(addr) >> 22)          // Page directory index of an address
+#define KVM_PTE(addr) (((unsigned int)(addr) >> 12) & 0x3FF)    // Page table index of an address
+#define KVM_FAULT_WRITE 0x002                               // Page fault error code: the access was a write
+#define KVM_CR0_WP 0x00010000                               // CR0: writes to read-only pages fault in ring 0 too
+#define KVM_CR0_PG 0x80000000                               // CR0: paging enabled
+
+/**
+ * Switches to the address space of a process
+ * Loading CR3 also flushes the stale translations of the last process.
+ * @param pid - process ID
+ */
+static inline void kvm_switch(int pid) {
+    set_cr3((unsigned int)pcb[pid]->page_dir);
+}
+
+void kvm_init();
+int kvm_create(int pid);
+void kvm_destroy(int pid);
+void kvm_map(int pid, void *addr, int count);
+void kvm_unmap(int pid, void *addr, int count);
+int kvm_fork(int parent, int child);
+void kvm_fault(trapframe_t *trapframe);
+int kvm_user_ok(unsigned int addr, unsigned int len);
+void kvm_print_stats();
+
+#endif
@@ -11,9 +11,19 @@
 #include "kernel.h"
 #include "kisr.h"
 #include "kproc.h"
+#include "ktimer.h"
+#include "kmutex.h"
+#include "kpage.h"
+#include "kqueue.h"
+#include "kslab.h"
+#include "kvm.h"
+#include "ktopic.h"
+#include "ksyscall.h"
+#include "vdso.h"
 #include "queue.h"
 #include "string.h"
 #include "user_proc.h"
+#include "bench_proc.h"
 
 // Local function definitions
 void kdata_init();
@@ -24,20 +34,71 @@ void idt_entry_add(int entry_num, func_ptr_t func_ptr);
  * Kernel data structures
  */
 
-int system_time, run_pid;                               // Current system time and current running process ID
-queue_t available_q, run_q ,idle_q, sleep_q;            // Process queues
-pcb_t pcb[PROC_MAX];  									// Process table
+tick_t system_time;                                     // Current system time (ticks since boot)
+int run_pid;                                            // Current running process ID
+unsigned long long tsc_boot;                            // Time stamp counter at boot
+unsigned int tsc_khz;                                   // Time stamp counter frequency
+int sleep_head, sleep_count;                            // Sleep list ordered by wake time
+int tickless, tickless_ticks;                           // Tickless idle mode and pending one-shot length
+unsigned int ticks_skipped;                             // Timer interrupts avoided by tickless idle
+int ipc_direct_switch;                                  // Switch straight to a waiting receiver on msg_send
+kqueue_t prio_q[PRIO_LEVELS];                           // Run queues, one per priority level
+unsigned int prio_bitmap;                               // Non-empty run queue levels
+sched_stats_t sched_stats;                              // Scheduler statistics
+timer_stats_t timer_stats;                              // Timer interrupt statistics
+msg_prio_stats_t msg_prio_stats[MSG_PRIO_LEVELS];       // Message queueing delay per priority band
+pcb_t *pcb[PID_MAX+1];  								// Process table, indexed by PID
+int pid_next;                                           // Next process ID to try handing out
 
 // Semaphores
-semaphore_t semaphores[SEMAPHORE_MAX];
+semaphore_t *semaphores[SEMAPHORE_MAX];
 queue_t semaphore_q;
+kqueue_t futex_q[FUTEX_BUCKETS];
+
+// Mutexes
+kmutex_t mutexes[MUTEX_MAX];
+queue_t mutex_q;
+
+// Condition variables and reader-writer locks
+kcond_t conds[COND_MAX];
+queue_t cond_q;
+krwlock_t rwlocks[RWLOCK_MAX];
+queue_t rwlock_q;
 
 // Mailboxes
-mailbox_t mailboxes[MBOX_MAX];   
+mailbox_t *mailboxes[MBOX_MAX];
+
+// Shared rings
+ring_t rings[RING_MAX];
+
+// Publish/subscribe topics and their message buffers
+topic_t topics[TOPIC_MAX];
+topic_buf_t topic_bufs[TOPIC_BUFS];
+int topic_free;
+
+// Shared memory segments and the pages behind them
+shm_t shm_segs[SHM_MAX];
+unsigned char kpages[KPAGE_COUNT][KPAGE_SIZE] __attribute__((aligned(KPAGE_SIZE)));
+unsigned int kpage_bitmap[(KPAGE_COUNT + 31) / 32];
+kpage_stats_t kpage_stats;
+unsigned short kpage_refs[KPAGE_COUNT];
+
+// Kernel address space
+unsigned int kvm_kernel_pd[KVM_ENTRIES] __attribute__((aligned(KPAGE_SIZE)));
+unsigned int kvm_ident_pt[KVM_IDENT_PTS][KVM_ENTRIES] __attribute__((aligned(KPAGE_SIZE)));
+unsigned int kvm_fault_code;
+kvm_stats_t kvm_stats;
+
+// Object caches for process control blocks, semaphores and mailboxes
+kslab_t pcb_cache;
+kslab_t sem_cache;
+kslab_t mbox_cache;
 
-char stack[PROC_MAX][PROC_STACK_SIZE];                  // runtime stacks of processes
 struct i386_gate *idt_p;								// Interrupt descriptor table
 
+// Shared kernel information page (a page of its own, mapped read-only into processes)
+vdso_t vdso;
+
 /**
  * Main entry point for our kernel/operating system
  * This function initializes all kernel data and hardware then begins
@@ -45,13 +106,20 @@ struct i386_gate *idt_p;								// Interrupt descriptor table
  */
 int main() {
 
+    trapframe_t *trapframe;
+
     kdata_init();                                       // Initialize kernel data structures
     idt_init();                                         // Initialize the IDT
-    kproc_exec("ktask_idle", &ktask_idle, &idle_q);                         // Launch the kernel idle task
-    kproc_exec("dispatcher_proc", &dispatcher_proc, &run_q);         // Launch the dispatcher process
-    kproc_exec("printer_proc", &printer_proc, &run_q);               // Launch the printer process
+    kvm_init();                                         // Turn on paging
+    ktimer_init();                                      // Calibrate the time stamp counter
+    vdso_init();                                        // Publish the shared kernel information page
+    kproc_exec_stack("ktask_idle", &ktask_idle, PRIO_IDLE, KPAGE_SIZE);   // Launch the kernel idle task (it needs little stack)
+    kproc_exec("dispatcher_proc", &dispatcher_proc, PRIO_HIGH);      // Launch the dispatcher process
+    kproc_exec("printer_proc", &printer_proc, PRIO_DEFAULT);         // Launch the printer process
     kproc_schedule();                                   // Start the process scheduler
-    kproc_load(pcb[run_pid].trapframe_p);               // Load the first scheduled process (effectively: the idle task)
+    trapframe = pcb[run_pid]->trapframe_p;              // The PCB is out of reach once the process' address space is loaded
+    kvm_switch(run_pid);
+    kproc_load(trapframe);                              // Load the first scheduled process (effectively: the idle task)
     return 0;                                           // should never be reached
 
 }
@@ -62,42 +130,110 @@ int main() {
  */
 void kdata_init() {
 
-    int i, check = 0;                                  // Counter variable for the for loop and check for initialize qs
+    int i, j, check = 0;                                // Counter variable for the for loop and check for initialize qs
 
     // Initialize all of our kernel queues
-	check = initializeQueue(&available_q);
-	check += initializeQueue(&run_q);
-    check += initializeQueue(&idle_q);
-    check += initializeQueue(&sleep_q);
-    check += initializeQueue(&semaphore_q);
+    check = initializeQueue(&semaphore_q);
+    check += initializeQueue(&mutex_q);
+    check += initializeQueue(&cond_q);
+    check += initializeQueue(&rwlock_q);
 
     //If the initializeQueue function returns a non zero value, then queues were not initialized. Call panic()
     if(check != 0)
         panic("Error, the queues were not initialized properly. Null pointer found\n");
 
-    // Initialize process control blocks and stacks
+    // Process control blocks, semaphores and mailboxes are created on demand
     sp_memset((char *)&pcb, 0, sizeof(pcb));
-    sp_memset((char *)&stack, 0, sizeof(stack));
     sp_memset((char *)&semaphores, 0, sizeof(semaphores));
     sp_memset((char *)&mailboxes, 0, sizeof(mailboxes));
+    sp_memset((char *)&mutexes, 0, sizeof(mutexes));
+    sp_memset((char *)&conds, 0, sizeof(conds));
+    sp_memset((char *)&rwlocks, 0, sizeof(rwlocks));
+    sp_memset((char *)&rings, 0, sizeof(rings));
+    sp_memset((char *)&shm_segs, 0, sizeof(shm_segs));
+    sp_memset((char *)&kpage_bitmap, 0, sizeof(kpage_bitmap));   // Every page is free
+    sp_memset((char *)&kpage_stats, 0, sizeof(kpage_stats));
+    sp_memset((char *)&kpage_refs, 0, sizeof(kpage_refs));
+    sp_memset((char *)&kvm_stats, 0, sizeof(kvm_stats));
+    sp_memset((char *)&sched_stats, 0, sizeof(sched_stats));
+    sp_memset((char *)&timer_stats, 0, sizeof(timer_stats));
+    sp_memset((char *)&msg_prio_stats, 0, sizeof(msg_prio_stats));
+    prio_bitmap = 0;                                // No process is ready to run yet
+    sleep_head = -1;                                // No process is sleeping yet
+    sleep_count = 0;
+    tickless = 1;                                   // Stop the timer tick when only the idle task can run
+    tickless_ticks = 0;
+    ticks_skipped = 0;
+    ipc_direct_switch = 1;                          // Run a waiting receiver as soon as its message arrives
+
+    kslab_init(&pcb_cache, "pcb", sizeof(pcb_t), PROC_MAX);
+    kslab_init(&sem_cache, "semaphore", sizeof(semaphore_t), SEMAPHORE_MAX);
+    kslab_init(&mbox_cache, "mailbox", sizeof(mailbox_t), MBOX_MAX);
+
+    pid_next = 0;                                   // The idle task gets PID 0
+
+    // Process queues start out empty
+    for (i = 0; i < PRIO_LEVELS; i++) {
+        kqueue_init(&prio_q[i]);
+    }
 
-    // Ensure that all processes are initially in our available queue
-    for (i = 0; i < PROC_MAX; i++) {
-        enqueue(&available_q, i);
-        pcb[i].state = AVAILABLE;                   // State of processes should be AVAILABLE
+    for (i = 0; i < FUTEX_BUCKETS; i++) {
+        kqueue_init(&futex_q[i]);
     }
 
-    // Ensure that all semaphores and the corresponding array is initialized properly
+    // Semaphore IDs are handed out from semaphore_q
     for(i = 0; i < SEMAPHORE_MAX; i++){
 
         enqueue(&semaphore_q, i);
-        semaphores[i].count = 0;
-        semaphores[i].init = SEMAPHORE_UNINITIALIZED;
-        if(initializeQueue(&(semaphores[i].wait_q)) != 0)
-           panic("Error, the semaphore wait_q could not be initialized\n");
 
     }
 
+    // Mutexes are handed out from mutex_q the same way
+    for(i = 0; i < MUTEX_MAX; i++){
+
+        enqueue(&mutex_q, i);
+        mutexes[i].owner = -1;
+        mutexes[i].init = MUTEX_UNINITIALIZED;
+        kqueue_init(&(mutexes[i].wait_q));
+
+    }
+
+    for(i = 0; i < COND_MAX; i++){
+
+        enqueue(&cond_q, i);
+        conds[i].init = COND_UNINITIALIZED;
+        kqueue_init(&(conds[i].wait_q));
+
+    }
+
+    for(i = 0; i < RWLOCK_MAX; i++){
+
+        enqueue(&rwlock_q, i);
+        rwlocks[i].writer = -1;
+        rwlocks[i].init = RWLOCK_UNINITIALIZED;
+        kqueue_init(&(rwlocks[i].read_q));
+        kqueue_init(&(rwlocks[i].write_q));
+
+    }
+
+    // Topics start without subscribers and every buffer on the free list
+    sp_memset((char *)&topics, 0, sizeof(topics));
+    for(i = 0; i < TOPIC_MAX; i++){
+
+        for(j = 0; j < TOPIC_SUBS; j++)
+            topics[i].sub[j].pid = -1;
+        kqueue_init(&(topics[i].wait_q));
+
+    }
+
+    for(i = 0; i < TOPIC_BUFS; i++){
+
+        topic_bufs[i].refs = 0;
+        topic_bufs[i].next = i + 1 < TOPIC_BUFS ? i + 1 : -1;
+
+    }
+    topic_free = 0;
+
     //sem = SEMAPHORE_UNINITIALIZED;                  // Defalult value 
     system_time = 0;                                // Initialize system time
     run_pid = -1;                                   // Initializa the running pid'
@@ -115,6 +251,8 @@ void idt_init() {
     // Add an entry for each interrupt into the IDT
     idt_entry_add(TIMER_INTR, kisr_entry_timer);
     idt_entry_add(SYSCALL_INTR, syscall_interrupt); 
+    idt_entry_add(SYSCALL_FAST_INTR, kisr_entry_fast);
+    idt_entry_add(PAGE_FAULT_INTR, kisr_entry_page_fault);
 
     // Clear the PIC mask to enable interrupts
     outportb(0x21, ~1);
@@ -151,25 +289,33 @@ void idt_entry_add(int entry_num, func_ptr_t func_ptr) {
  */
 void kernel_run(trapframe_t *trapframe) {
     char key;
+    int i;
+    unsigned int cycles;
 
     if (run_pid < 0 || run_pid > PID_MAX) {
         panic("Invalid PID!");
     }
 
     // save the trapframe into the PCB of the currently running process
-    pcb[run_pid].trapframe_p = trapframe;
+    pcb[run_pid]->trapframe_p = trapframe;
 
     // Process the current interrupt and call the appropriate service routine
     switch (trapframe->interrupt) {
         // Timer interrupt
         case TIMER_INTR:
+            cycles = ktimer_cycles();
             kisr_timer();
+            ktimer_record(ktimer_cycles() - cycles);
             break;
 
         case SYSCALL_INTR:
             kisr_syscall();
             break;
 
+        case PAGE_FAULT_INTR:
+            kvm_fault(trapframe);
+            break;
+
         default:
             panic("Invalid interrupt");
             break;
@@ -187,7 +333,106 @@ void kernel_run(trapframe_t *trapframe) {
 
             case 'n':
                 // Create a new process
-                kproc_exec("user_proc", &user_proc, &run_q);
+                kproc_exec("user_proc", &user_proc, PRIO_DEFAULT);
+                break;
+
+            case 'l':
+                // Start the wakeup latency benchmark: one sleeper against CPU hogs
+                sp_memset((char *)&sched_stats, 0, sizeof(sched_stats));
+                kproc_exec("bench_wake_proc", &bench_wake_proc, PRIO_DEFAULT);
+                for (i = 0; i < BENCH_HOGS; i++) {
+                    if (kproc_exec("bench_hog_proc", &bench_hog_proc, PRIO_DEFAULT) < 0) {
+                        break;
+                    }
+                }
+                break;
+
+            case 'z':
+                // Start the timer tick cost benchmark: fill the process table with sleepers
+                sp_memset((char *)&timer_stats, 0, sizeof(timer_stats));
+                for (i = 0; i < PROC_MAX; i++) {
+                    if (kproc_exec("bench_sleep_proc", &bench_sleep_proc, PRIO_DEFAULT) < 0) {
+                        break;
+                    }
+                }
+                break;
+
+            case 'c':
+                // Start the system call round trip benchmark
+                kproc_exec("bench_syscall_proc", &bench_syscall_proc, PRIO_DEFAULT);
+                break;
+
+            case 'i':
+                // Start the IPC ping-pong benchmark (receiver first so it is waiting)
+                kproc_exec("bench_pong_proc", &bench_pong_proc, PRIO_DEFAULT);
+                kproc_exec("bench_ping_proc", &bench_ping_proc, PRIO_DEFAULT);
+                break;
+
+            case 'v':
+                // Start the batched IPC benchmark (receiver first so it is waiting)
+                kproc_exec("bench_batch_recv_proc", &bench_batch_recv_proc, PRIO_DEFAULT);
+                kproc_exec("bench_batch_send_proc", &bench_batch_send_proc, PRIO_DEFAULT);
+                break;
+
+            case 'f':
+                // Start the semaphore fast path benchmark
+                kproc_exec("bench_sem_proc", &bench_sem_proc, PRIO_DEFAULT);
+                break;
+
+            case 'r':
+                // Start the streaming benchmark (receiver first so it is waiting)
+                kproc_exec("bench_stream_recv_proc", &bench_stream_recv_proc, PRIO_DEFAULT);
+                kproc_exec("bench_stream_send_proc", &bench_stream_send_proc, PRIO_DEFAULT);
+                break;
+
+            case 'g':
+                // Start the scaling benchmark: add runnable processes, then time the
+                // scheduler, wakeup latency and the IPC ping-pong with all of them ready
+                for (i = 0; i < BENCH_SCALE_STEP; i++) {
+                    if (kproc_exec_stack("bench_scale_proc", &bench_scale_proc, PRIO_LOW, KPAGE_SIZE) < 0) {
+                        break;
+                    }
+                }
+                cons_printf("scaling benchmark: %d processes, %d runnable at level %d\n",
+                            pcb_cache.live, prio_q[PRIO_LOW].size, PRIO_LOW);
+                sp_memset((char *)&sched_stats, 0, sizeof(sched_stats));
+                kproc_exec("bench_scale_report_proc", &bench_scale_report_proc, PRIO_DEFAULT);
+                kproc_exec("bench_pong_proc", &bench_pong_proc, PRIO_DEFAULT);
+                kproc_exec("bench_ping_proc", &bench_ping_proc, PRIO_DEFAULT);
+                break;
+
+            case 'o':
+                // Check that an exiting subscriber leaves its topics
+                kproc_exec("bench_topic_sub_proc", &bench_topic_sub_proc, PRIO_DEFAULT);
+                kproc_exec("bench_topic_exit_proc", &bench_topic_exit_proc, PRIO_DEFAULT);
+                break;
+
+            case 'k':
+                // Start the copy-on-write fork benchmark
+                kproc_exec("bench_fork_proc", &bench_fork_proc, PRIO_DEFAULT);
+                break;
+
+            case 'd':
+                // Toggle switching straight to a waiting message receiver
+                ipc_direct_switch = !ipc_direct_switch;
+                printf("IPC direct switch %s\n", ipc_direct_switch ? "on" : "off");
+                break;
+
+            case 't':
+                // Toggle tickless idle mode
+                tickless = !tickless;
+                break;
+
+            case 's':
+                // Display scheduler, timer, mutex, page, object cache, paging, topic and message statistics
+                kproc_print_stats();
+                ktimer_print_stats();
+                kmutex_print_stats();
+                kpage_print_stats();
+                kslab_print_stats();
+                kvm_print_stats();
+                ktopic_print_stats();
+                mbox_print_stats();
                 break;
 
             case 'p':
@@ -220,7 +465,14 @@ void kernel_run(trapframe_t *trapframe) {
     // Run the process scheduler
     kproc_schedule();
 
-    // Load the next process
-    kproc_load(pcb[run_pid].trapframe_p);
+    // Stop the periodic tick if only the idle task is left to run
+    if (pcb[run_pid]->priority == PRIO_IDLE) {
+        ktimer_tickless_enter();
+    }
+
+    // Load the next process and its address space
+    trapframe = pcb[run_pid]->trapframe_p;
+    kvm_switch(run_pid);
+    kproc_load(trapframe);
     
 }
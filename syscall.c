@@ -6,8 +6,11 @@
  * System call APIs
  */
  
+#include "spede.h"
 #include "syscall.h"
 #include "kernel.h"
+#include "string.h"
+#include "vdso.h"
 
 /*
  * Anatomy of a system call
@@ -53,6 +56,12 @@
  *         : "eax", "ebx");     // restore the registers that were used
  *     return y;
  * }
+ *
+ * System information (get_sys_time, get_time_ns, get_proc_pid,
+ * get_proc_name) does not trap at all: these wrappers read it from the
+ * shared kernel information page (see vdso.h). None of them use int 0x80
+ * or the fast system call interrupt 0x81 any more; the kernel still serves
+ * both for code that traps directly (the benchmarks in bench_proc.c).
  */
 
 /**
@@ -76,76 +85,108 @@ void proc_exit()
 } 
 
 /**
- * Returns the current system time (in seconds)
+ * Starts a worker process that shares the caller's data window
+ * copy-on-write
  *
- * @return integer value for the system time in seconds
+ * @param   func - function the worker runs
+ * @return  process ID of the worker, -1 on error
  */
-int get_sys_time()
+int proc_fork(func_ptr_t func)
 {
-    // trigger the system call
-    // no data sent to the kernel
-    // data is returned from the kernel
-	int SystemTime;
-	
+	int pid;
+
 	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
 		"int $0x80;"
 		"movl %%ebx, %0;"
-		: "=g"(SystemTime)
-		: "g"(SYSCALL_GET_SYS_TIME)
-		: "%eax", "%ebx"		
-		);
-		
-	return SystemTime;
+		: "=g" (pid)
+		: "g" (SYSCALL_PROC_FORK),
+		  "g" (func)
+		: "eax", "ebx");
+
+	return pid;
+}
+
+/**
+ * Returns the current system time (in seconds)
+ * Read from the shared kernel information page
+ *
+ * @return integer value for the system time in seconds
+ */
+int get_sys_time()
+{
+	unsigned int seq;
+	long long ticks;
+
+	do {
+		seq = vdso_read_begin();
+		ticks = vdso.system_time;
+	} while (vdso_read_retry(seq));
+
+	return (int)(ticks / vdso.tick_rate);
+}
+
+/**
+ * Returns the time since boot (in nanoseconds)
+ * Computed from the time stamp counter and the calibration published in
+ * the shared kernel information page
+ *
+ * @return 64-bit monotonic time in nanoseconds
+ */
+unsigned long long get_time_ns()
+{
+	unsigned long long tsc, cycles, ms;
+
+	asm volatile("rdtsc" : "=A"(tsc));
+
+	// Split at millisecond boundaries so the multiplication cannot overflow
+	cycles = tsc - vdso.tsc_boot;
+	ms = cycles / vdso.tsc_khz;
+	return ms * 1000000 + (cycles - ms * vdso.tsc_khz) * 1000000 / vdso.tsc_khz;
 }
 
 /**
  * Returns the currently running (calling) process' process ID
+ * Read from the shared kernel information page
  *
  * @return integer value representing the process ID; -1 on error
  */
 int get_proc_pid() {
 
-    int pid = 0;
-    asm("movl %1, %%eax;"			//eax register indicates the syscall
-        "int $0x80;"				//trigger the syscall
-        "movl %%ebx, %0;"			//pull data back from the kernel via handler
-        : "=g"(pid)					//op 0 is returned from kernel
-        : "g"(SYSCALL_GET_PROC_PID)	//op 1 is the syscall
-        : "%eax", "%ebx"			//restore the registers
-		);
+	unsigned int seq;
+	int pid;
+
+	do {
+		seq = vdso_read_begin();
+		pid = vdso.run_pid;
+	} while (vdso_read_retry(seq));
 
-    return pid;
+	return pid;
 }
 
 /**
  * Returns the currently running (calling) process' name
+ * Read from the shared kernel information page
  *
  * @param   name
  * @return  0 upon success, other value upon error
  */
 int get_proc_name(char *name) 
 {
-    // trigger the system call
-    // destination pointer is sent to the kernel
-    // no data is returned from the kernel
-	
-	asm("movl %0, %%eax;"
-        "movl %1, %%ebx;"
-		"int $0x80;"
-		:
-        :"g"(SYSCALL_GET_PROC_NAME),
-		 "g"(name)
-		:"%eax", "%ebx"
-		);
-		
-	if (name != '\0')
+	unsigned int seq;
+
+	if (name == NULL)
 	{
-		return 0;
-	}
-	else
 		panic_warn("Error at get_proc_name");
+		return -1;
+	}
 
-	return -1;
+	do {
+		seq = vdso_read_begin();
+		sp_strcpy(name, vdso.run_name);
+	} while (vdso_read_retry(seq));
+
+	return 0;
 
 }
 
@@ -157,30 +198,47 @@ int get_proc_name(char *name)
  * @return  none
  */
 void sleep(int seconds)
+{
+	sleep_ms(seconds * 1000);
+}
+
+/**
+ * Puts the currently running (calling) process to sleep for the
+ * specified number of milliseconds.
+ *
+ * @param   ms - number of milliseconds for the process to sleep
+ * @return  none
+ */
+void sleep_ms(unsigned int ms)
 {
     // trigger the system call
-    // sleep amount (in seconds) is sent to the kernel
+    // sleep amount (in milliseconds) is sent to the kernel
     // no data is returned from the kernel
-/* 	asm("movl %1, %%eax;"
-		"movl %2, %%ebx;"
-		"int $0x80;"
-		: "g"(SYSCALL_SLEEP)
-		: "g"(seconds)
-		: "%eax", "%ebx"
-		); */
-/* 	asm("movl %0, %%eax; int $0x80"
-        :
-        : "g"(seconds), "g"(SYSCALL_SLEEP)
-        : "eax"
-    ); */
 	asm("movl %0, %%eax;"    // eax register indicates the syscall
           "movl %1, %%ebx;"    // send data to the kernel
           "int $0x80;"         // trigger the syscall via interrupt 0x80
           :                    // no operands for return data
-          : "g" (SYSCALL_SLEEP), // operand 0 is the syscall
-            "g" (seconds)            // operand 1 is the data we are sending
+          : "g" (SYSCALL_SLEEP_MS), // operand 0 is the syscall
+            "g" (ms)            // operand 1 is the data we are sending
           : "%eax", "%ebx");     // restore the registers that were used
-		  
+}
+
+/**
+ * Puts the currently running (calling) process to sleep for the
+ * specified number of microseconds.
+ *
+ * @param   us - number of microseconds for the process to sleep
+ * @return  none
+ */
+void sleep_us(unsigned int us)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_SLEEP_US),
+		  "g" (us)
+		: "%eax", "%ebx");
 }
 
 void sem_init(sem_t *sem)
@@ -202,6 +260,51 @@ void sem_wait(sem_t *sem)
 		:
 		: "g" (SYSCALL_SEM_WAIT),
 		  "g" (sem)
+		: "eax", "ebx", "edx");
+}
+
+int sem_trywait(sem_t *sem)
+{
+	int rc;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// result is returned in edx
+		: "=g" (rc)
+		: "g" (SYSCALL_SEM_TRYWAIT),
+		  "g" (sem)
+		: "eax", "ebx", "edx");
+
+	return rc;
+}
+
+int sem_timedwait(sem_t *sem, int ms)
+{
+	int rc;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// result is returned in edx
+		: "=g" (rc)
+		: "g" (SYSCALL_SEM_TIMEDWAIT),
+		  "g" (sem),
+		  "g" (ms)
+		: "eax", "ebx", "ecx", "edx");
+
+	return rc;
+}
+
+void sem_destroy(sem_t *sem)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_SEM_DESTROY),
+		  "g" (sem)
 		: "eax", "ebx");
 }
 
@@ -215,6 +318,412 @@ void sem_post(sem_t *sem)
 		  "g" (sem)
 		: "eax", "ebx");
 }
+
+void mutex_init(mutex_t *mutex)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_MUTEX_INIT),
+		  "g" (mutex)
+		: "eax", "ebx");
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_MUTEX_LOCK),
+		  "g" (mutex)
+		: "eax", "ebx");
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_MUTEX_UNLOCK),
+		  "g" (mutex)
+		: "eax", "ebx");
+}
+
+void cond_init(cond_t *cond)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_COND_INIT),
+		  "g" (cond)
+		: "eax", "ebx");
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"movl %2, %%ecx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_COND_WAIT),
+		  "g" (cond),
+		  "g" (mutex)
+		: "eax", "ebx", "ecx");
+}
+
+void cond_signal(cond_t *cond)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_COND_SIGNAL),
+		  "g" (cond)
+		: "eax", "ebx");
+}
+
+void cond_broadcast(cond_t *cond)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_COND_BROADCAST),
+		  "g" (cond)
+		: "eax", "ebx");
+}
+
+void rwlock_init(rwlock_t *rwlock)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_RWLOCK_INIT),
+		  "g" (rwlock)
+		: "eax", "ebx");
+}
+
+void rwlock_rdlock(rwlock_t *rwlock)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_RWLOCK_RDLOCK),
+		  "g" (rwlock)
+		: "eax", "ebx");
+}
+
+void rwlock_wrlock(rwlock_t *rwlock)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_RWLOCK_WRLOCK),
+		  "g" (rwlock)
+		: "eax", "ebx");
+}
+
+void rwlock_unlock(rwlock_t *rwlock)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_RWLOCK_UNLOCK),
+		  "g" (rwlock)
+		: "eax", "ebx");
+}
+
+int futex_wait(volatile int *addr, int val)
+{
+	int rc;
+
+	asm volatile("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// 0 if woken, -1 if the value had changed
+		: "=g" (rc)
+		: "g" (SYSCALL_FUTEX_WAIT),
+		  "g" (addr),
+		  "g" (val)
+		: "eax", "ebx", "ecx", "edx", "memory");
+
+	return rc;
+}
+
+int futex_wake(volatile int *addr, int count)
+{
+	int woken;
+
+	asm volatile("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// number of processes woken
+		: "=g" (woken)
+		: "g" (SYSCALL_FUTEX_WAKE),
+		  "g" (addr),
+		  "g" (count)
+		: "eax", "ebx", "ecx", "edx", "memory");
+
+	return woken;
+}
+
+/*
+ * Atomically adds to a word in memory
+ * @return the previous value
+ */
+static inline int atomic_add(volatile int *addr, int val)
+{
+	asm volatile("lock; xaddl %0, %1"
+		: "+r" (val), "+m" (*addr)
+		:
+		: "memory");
+
+	return val;
+}
+
+/*
+ * Atomically replaces a word in memory if it still holds the old value
+ * @return the value found in memory (equal to old on success)
+ */
+static inline int atomic_cmpxchg(volatile int *addr, int old, int new_val)
+{
+	int prev;
+
+	asm volatile("lock; cmpxchgl %2, %1"
+		: "=a" (prev), "+m" (*addr)
+		: "r" (new_val), "0" (old)
+		: "memory");
+
+	return prev;
+}
+
+/*
+ * Orders all earlier memory accesses before all later ones
+ */
+static inline void atomic_fence()
+{
+	asm volatile("lock; addl $0, (%%esp)" : : : "memory");
+}
+
+void *shm_create(char *name, int size)
+{
+	void *addr;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"int $0x80;"
+		"movl %%ebx, %0;"
+		: "=g" (addr)
+		: "g" (SYSCALL_SHM_CREATE),
+		  "g" (name),
+		  "g" (size)
+		: "eax", "ebx", "ecx");
+
+	return addr;
+}
+
+void *shm_attach(char *name)
+{
+	void *addr;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"int $0x80;"
+		"movl %%ebx, %0;"
+		: "=g" (addr)
+		: "g" (SYSCALL_SHM_ATTACH),
+		  "g" (name)
+		: "eax", "ebx");
+
+	return addr;
+}
+
+void shm_detach(char *name)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_SHM_DETACH),
+		  "g" (name)
+		: "eax", "ebx");
+}
+
+ring_t *ring_attach(int ring_num)
+{
+	ring_t *ring;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"int $0x80;"
+		"movl %%ebx, %0;"
+		: "=g" (ring)
+		: "g" (SYSCALL_RING_ATTACH),
+		  "g" (ring_num)
+		: "eax", "ebx");
+
+	return ring;
+}
+
+void ring_write(ring_t *ring, void *buf, int len)
+{
+	unsigned int head, tail, n, off;
+	unsigned char *src = (unsigned char *)buf;
+
+	while (len > 0)
+	{
+		head = ring->head;
+		tail = ring->tail;
+
+		// full: announce that we wait, then sleep unless head moved meanwhile
+		if (tail - head == RING_BYTES)
+		{
+			ring->writer_waiting = 1;
+			atomic_fence();
+			if (ring->head == head)
+			{
+				futex_wait((volatile int *)&ring->head, (int)head);
+			}
+			ring->writer_waiting = 0;
+			continue;
+		}
+
+		n = RING_BYTES - (tail - head);
+		if (n > (unsigned int)len)
+		{
+			n = len;
+		}
+
+		// copy in at most two pieces, then publish the new tail
+		off = tail & (RING_BYTES - 1);
+		if (off + n <= RING_BYTES)
+		{
+			sp_memcpy(&ring->data[off], src, n);
+		}
+		else
+		{
+			sp_memcpy(&ring->data[off], src, RING_BYTES - off);
+			sp_memcpy(ring->data, src + RING_BYTES - off, n - (RING_BYTES - off));
+		}
+		atomic_fence();
+		ring->tail = tail + n;
+		src += n;
+		len -= n;
+
+		atomic_fence();
+		if (ring->reader_waiting)
+		{
+			futex_wake((volatile int *)&ring->tail, 1);
+		}
+	}
+}
+
+void ring_read(ring_t *ring, void *buf, int len)
+{
+	unsigned int head, tail, n, off;
+	unsigned char *dst = (unsigned char *)buf;
+
+	while (len > 0)
+	{
+		head = ring->head;
+		tail = ring->tail;
+
+		// empty: announce that we wait, then sleep unless tail moved meanwhile
+		if (tail == head)
+		{
+			ring->reader_waiting = 1;
+			atomic_fence();
+			if (ring->tail == tail)
+			{
+				futex_wait((volatile int *)&ring->tail, (int)tail);
+			}
+			ring->reader_waiting = 0;
+			continue;
+		}
+
+		n = tail - head;
+		if (n > (unsigned int)len)
+		{
+			n = len;
+		}
+
+		// copy out at most two pieces, then publish the new head
+		off = head & (RING_BYTES - 1);
+		if (off + n <= RING_BYTES)
+		{
+			sp_memcpy(dst, &ring->data[off], n);
+		}
+		else
+		{
+			sp_memcpy(dst, &ring->data[off], RING_BYTES - off);
+			sp_memcpy(dst + RING_BYTES - off, ring->data, n - (RING_BYTES - off));
+		}
+		atomic_fence();
+		ring->head = head + n;
+		dst += n;
+		len -= n;
+
+		atomic_fence();
+		if (ring->writer_waiting)
+		{
+			futex_wake((volatile int *)&ring->head, 1);
+		}
+	}
+}
+
+void fsem_init(fsem_t *sem, int count)
+{
+	sem->count = count;
+	sem->waiters = 0;
+}
+
+void fsem_wait(fsem_t *sem)
+{
+	int count;
+
+	while (1)
+	{
+		// fast path: take a unit without entering the kernel
+		count = sem->count;
+		while (count > 0)
+		{
+			if (atomic_cmpxchg(&sem->count, count, count - 1) == count)
+			{
+				return;
+			}
+			count = sem->count;
+		}
+
+		// slow path: sleep until a post makes the count non-zero
+		atomic_add(&sem->waiters, 1);
+		futex_wait(&sem->count, 0);
+		atomic_add(&sem->waiters, -1);
+	}
+}
+
+void fsem_post(fsem_t *sem)
+{
+	atomic_add(&sem->count, 1);
+
+	// only trap if someone is (about to be) blocked
+	if (sem->waiters > 0)
+	{
+		futex_wake(&sem->count, 1);
+	}
+}
+
 /*
 	    asm("movl %0, %%eax;"    // eax register indicates the syscall
  *         "movl %1, %%ebx;"    // send data to the kernel
@@ -226,27 +735,250 @@ void sem_post(sem_t *sem)
  * */
 
 void msg_send(msg_t *msg, int mbox_num)
+{
+	msg_send_len(msg, MSG_SIZE, mbox_num);
+}
+
+void msg_send_prio(msg_t *msg, int mbox_num, int prio)
+{
+	msg_send_prio_len(msg, MSG_SIZE, mbox_num, prio);
+}
+
+void msg_send_prio_len(msg_t *msg, int len, int mbox_num, int prio)
 {
 	asm("movl %0, %%eax;"
 		"movl %1, %%ebx;"
 		"movl %2, %%ecx;"
+		"movl %3, %%edx;"
+		"movl %4, %%esi;"
 		"int $0x80;"
 		:
-		: "g" (SYSCALL_MSG_SEND),
+		: "g" (SYSCALL_MSG_SEND_PRIO),
 		  "g" (msg),
-		  "g" (mbox_num)
-		: "eax", "ebx", "ecx");
+		  "g" (mbox_num),
+		  "g" (len),
+		  "g" (prio)
+		: "eax", "ebx", "ecx", "edx", "esi");
 }
 
-void msg_recv(msg_t *msg, int mbox_num)
+void msg_send_len(msg_t *msg, int len, int mbox_num)
 {
 	asm("movl %0, %%eax;"
 		"movl %1, %%ebx;"
 		"movl %2, %%ecx;"
+		"movl %3, %%edx;"
 		"int $0x80;"
 		:
+		: "g" (SYSCALL_MSG_SEND),
+		  "g" (msg),
+		  "g" (mbox_num),
+		  "g" (len)
+		: "eax", "ebx", "ecx", "edx");
+}
+
+int msg_trysend(msg_t *msg, int len, int mbox_num)
+{
+	int rc;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"movl %4, %%edx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// result is returned in edx
+		: "=g" (rc)
+		: "g" (SYSCALL_MSG_TRYSEND),
+		  "g" (msg),
+		  "g" (mbox_num),
+		  "g" (len)
+		: "eax", "ebx", "ecx", "edx");
+
+	return rc;
+}
+
+void msg_recv(msg_t *msg, int mbox_num)
+{
+	msg_recv_len(msg, mbox_num);
+}
+
+int msg_recv_len(msg_t *msg, int mbox_num)
+{
+	int len;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// received length is returned in edx
+		: "=g" (len)
 		: "g" (SYSCALL_MSG_RECV),
 		  "g" (msg),
 		  "g" (mbox_num)
-		: "eax", "ebx", "ecx");
+		: "eax", "ebx", "ecx", "edx");
+
+	return len;
+}
+
+int msg_recv_timeout(msg_t *msg, int mbox_num, int ms)
+{
+	int len;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"movl %4, %%edx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// received length or error is returned in edx
+		: "=g" (len)
+		: "g" (SYSCALL_MSG_RECV_TIMEOUT),
+		  "g" (msg),
+		  "g" (mbox_num),
+		  "g" (ms)
+		: "eax", "ebx", "ecx", "edx");
+
+	return len;
+}
+
+int msg_tryrecv(msg_t *msg, int mbox_num)
+{
+	int len;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// received length or error is returned in edx
+		: "=g" (len)
+		: "g" (SYSCALL_MSG_TRYRECV),
+		  "g" (msg),
+		  "g" (mbox_num)
+		: "eax", "ebx", "ecx", "edx");
+
+	return len;
+}
+
+int msg_select(int *mbox_set, int count, int *ready_mbox, int ms)
+{
+	int ready;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"movl %4, %%edx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// ready mailbox or error is returned in edx
+		: "=g" (ready)
+		: "g" (SYSCALL_MSG_SELECT),
+		  "g" (mbox_set),
+		  "g" (count),
+		  "g" (ms)
+		: "eax", "ebx", "ecx", "edx");
+
+	if (ready < 0)
+	{
+		return ready;
+	}
+
+	*ready_mbox = ready;
+	return MSG_OK;
+}
+
+int topic_subscribe(int topic_num)
+{
+	int rc;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"int $0x80;"
+		"movl %%edx, %0;"
+		: "=g" (rc)
+		: "g" (SYSCALL_TOPIC_SUBSCRIBE),
+		  "g" (topic_num)
+		: "eax", "ebx", "edx");
+
+	return rc;
+}
+
+void topic_unsubscribe(int topic_num)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_TOPIC_UNSUBSCRIBE),
+		  "g" (topic_num)
+		: "eax", "ebx");
+}
+
+int topic_publish(msg_t *msg, int len, int topic_num)
+{
+	int rc;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"movl %4, %%edx;"
+		"int $0x80;"
+		"movl %%edx, %0;"
+		: "=g" (rc)
+		: "g" (SYSCALL_TOPIC_PUBLISH),
+		  "g" (msg),
+		  "g" (topic_num),
+		  "g" (len)
+		: "eax", "ebx", "ecx", "edx");
+
+	return rc;
+}
+
+int topic_recv(msg_t *msg, int topic_num)
+{
+	int len;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// received length is returned in edx
+		: "=g" (len)
+		: "g" (SYSCALL_TOPIC_RECV),
+		  "g" (msg),
+		  "g" (topic_num)
+		: "eax", "ebx", "ecx", "edx");
+
+	return len;
+}
+
+void msg_sendv(msg_vec_t *msgs, int count, int mbox_num)
+{
+	asm("movl %0, %%eax;"
+		"movl %1, %%ebx;"
+		"movl %2, %%ecx;"
+		"movl %3, %%edx;"
+		"int $0x80;"
+		:
+		: "g" (SYSCALL_MSG_SENDV),
+		  "g" (msgs),
+		  "g" (count),
+		  "g" (mbox_num)
+		: "eax", "ebx", "ecx", "edx");
+}
+
+void msg_recvv(msg_vec_t *buf, int max, int mbox_num, int *got)
+{
+	int count;
+
+	asm("movl %1, %%eax;"
+		"movl %2, %%ebx;"
+		"movl %3, %%ecx;"
+		"movl %4, %%edx;"
+		"int $0x80;"
+		"movl %%edx, %0;"		// received count is returned in edx
+		: "=g" (count)
+		: "g" (SYSCALL_MSG_RECVV),
+		  "g" (buf),
+		  "g" (max),
+		  "g" (mbox_num)
+		: "eax", "ebx", "ecx", "edx");
+
+	*got = count;
 }
@@ -3,18 +3,34 @@
 
 // IPC data structures (needed for forward declarations below)
 #include "ipc.h"
+#include "global.h"
 
 /*
  * Forces a process to exit
  */
 void proc_exit(void);
 
+/*
+ * Starts a worker process running the given function. The worker has its
+ * own stack but starts with the caller's data window (PROC_DATA_BASE),
+ * shared copy-on-write: each side sees its own changes only.
+ * @param func - function the worker runs
+ * @return process ID of the worker, -1 if it could not be started
+ */
+int proc_fork(func_ptr_t func);
+
 /*
  * Obtains the current system uptime (in seconds)
  * @return time in seconds
  */
 int get_sys_time(void);
 
+/*
+ * Obtains the current system uptime (in nanoseconds)
+ * @return monotonic time in nanoseconds
+ */
+unsigned long long get_time_ns(void);
+
 /*
  * Obtains the running process' id (pid)
  * @return integer < 0 on error, positive integer referring to the
@@ -35,6 +51,18 @@ int get_proc_name(char *name);
  */
 void sleep(int seconds);
 
+/*
+ * Forces the process to "sleep" for the specified number of milliseconds
+ * @param ms - number of milliseconds to sleep (rounded up to timer ticks)
+ */
+void sleep_ms(unsigned int ms);
+
+/*
+ * Forces the process to "sleep" for the specified number of microseconds
+ * @param us - number of microseconds to sleep (rounded up to timer ticks)
+ */
+void sleep_us(unsigned int us);
+
 /*
  * Initialize a semaphore
  * @param sem - pointer to the semaphore identifier
@@ -49,6 +77,31 @@ void sem_init(sem_t *sem);
  */
 void sem_wait(sem_t *sem);
 
+/*
+ * Takes a semaphore if it is free, without waiting
+ * @param sem - pointer to the semaphore identifier
+ * @return SEM_OK if taken, SEM_ERR_BUSY otherwise
+ */
+int sem_trywait(sem_t *sem);
+
+/*
+ * Waits on a semaphore for at most the given number of milliseconds
+ * @param sem - pointer to the semaphore identifier
+ * @param ms - longest time to wait (rounded up to timer ticks)
+ * @return SEM_OK if taken, SEM_ERR_TIMEOUT if the time ran out,
+ *         SEM_ERR_DESTROYED if the semaphore was destroyed
+ */
+int sem_timedwait(sem_t *sem, int ms);
+
+/*
+ * Destroys a semaphore so its identifier can be reused
+ * Processes waiting on it return SEM_ERR_DESTROYED. The identifier is
+ * reset to SEMAPHORE_UNINITIALIZED.
+ * @param sem - pointer to the semaphore identifier
+ * @return none
+ */
+void sem_destroy(sem_t *sem);
+
 /*
  * Posts a semaphore
  * @param sem - pointer to the semaphore identifier
@@ -56,8 +109,181 @@ void sem_wait(sem_t *sem);
  */
 void sem_post(sem_t *sem);
 
+/*
+ * Initialize a mutex
+ * @param mutex - pointer to the mutex identifier, MUTEX_UNINITIALIZED
+ *        the first time
+ * @return none
+ */
+void mutex_init(mutex_t *mutex);
+
+/*
+ * Locks a mutex, waiting while another process holds it
+ * While it waits, the holder runs with at least the caller's priority.
+ * @param mutex - pointer to the mutex identifier
+ * @return none
+ */
+void mutex_lock(mutex_t *mutex);
+
+/*
+ * Unlocks a mutex held by the calling process
+ * @param mutex - pointer to the mutex identifier
+ * @return none
+ */
+void mutex_unlock(mutex_t *mutex);
+
+/*
+ * Initialize a condition variable
+ * @param cond - pointer to the condition variable identifier,
+ *        COND_UNINITIALIZED the first time
+ * @return none
+ */
+void cond_init(cond_t *cond);
+
+/*
+ * Unlocks the mutex and waits until the condition variable is signaled,
+ * then locks the mutex again
+ * @param cond - pointer to the condition variable identifier
+ * @param mutex - pointer to a mutex held by the caller
+ * @return none
+ */
+void cond_wait(cond_t *cond, mutex_t *mutex);
+
+/*
+ * Wakes the first process waiting on a condition variable
+ * @param cond - pointer to the condition variable identifier
+ * @return none
+ */
+void cond_signal(cond_t *cond);
+
+/*
+ * Wakes every process waiting on a condition variable
+ * @param cond - pointer to the condition variable identifier
+ * @return none
+ */
+void cond_broadcast(cond_t *cond);
+
+/*
+ * Initialize a reader-writer lock
+ * @param rwlock - pointer to the lock identifier, RWLOCK_UNINITIALIZED
+ *        the first time
+ * @return none
+ */
+void rwlock_init(rwlock_t *rwlock);
+
+/*
+ * Locks a reader-writer lock for reading; any number of readers may hold
+ * it at once, new readers wait while a writer is waiting
+ * @param rwlock - pointer to the lock identifier
+ * @return none
+ */
+void rwlock_rdlock(rwlock_t *rwlock);
+
+/*
+ * Locks a reader-writer lock for writing
+ * @param rwlock - pointer to the lock identifier
+ * @return none
+ */
+void rwlock_wrlock(rwlock_t *rwlock);
+
+/*
+ * Unlocks a reader-writer lock held for reading or writing
+ * @param rwlock - pointer to the lock identifier
+ * @return none
+ */
+void rwlock_unlock(rwlock_t *rwlock);
+
+/*
+ * Blocks until woken by futex_wake, unless *addr no longer equals val
+ * @param addr - address of the word to wait on
+ * @param val - the value the caller last saw at addr
+ * @return 0 when woken, -1 if the value had already changed
+ */
+int futex_wait(volatile int *addr, int val);
+
+/*
+ * Wakes processes blocked in futex_wait on the given address
+ * @param addr - address of the word
+ * @param count - most processes to wake
+ * @return number of processes woken
+ */
+int futex_wake(volatile int *addr, int count);
+
+/*
+ * Initialize a futex-style semaphore
+ * @param sem - pointer to the semaphore
+ * @param count - initial number of units available
+ */
+void fsem_init(fsem_t *sem, int count);
+
+/*
+ * Takes a unit from a futex-style semaphore, blocking while there is none
+ * Only enters the kernel when the semaphore has to block
+ * @param sem - pointer to the semaphore
+ */
+void fsem_wait(fsem_t *sem);
+
+/*
+ * Returns a unit to a futex-style semaphore
+ * Only enters the kernel when a process is waiting
+ * @param sem - pointer to the semaphore
+ */
+void fsem_post(fsem_t *sem);
+
+/*
+ * Creates a named shared memory segment, filled with zeros
+ * Semaphores, mutexes and rings may be placed inside it.
+ * @param name - segment name (up to 15 characters)
+ * @param size - size in bytes, rounded up to whole pages
+ * @return address of the segment, NULL if the name is taken or there is
+ *         no memory left
+ */
+void *shm_create(char *name, int size);
+
+/*
+ * Attaches to a named shared memory segment created by another process
+ * @param name - segment name
+ * @return address of the segment, NULL if there is no such segment
+ */
+void *shm_attach(char *name);
+
+/*
+ * Detaches from a named shared memory segment; the segment is freed once
+ * its creator and every process that attached have detached
+ * @param name - segment name
+ */
+void shm_detach(char *name);
+
+/*
+ * Attaches to a shared single-producer/single-consumer ring
+ * @param ring_num - ring number (0 to RING_MAX-1)
+ * @return address of the ring, shared with the other process
+ */
+ring_t *ring_attach(int ring_num);
+
+/*
+ * Writes bytes to a shared ring; only the producer may call this
+ * Blocks while the ring is full, the kernel is only entered to sleep or
+ * to wake a sleeping consumer.
+ * @param ring - ring returned by ring_attach
+ * @param buf - data to write
+ * @param len - number of bytes to write
+ */
+void ring_write(ring_t *ring, void *buf, int len);
+
+/*
+ * Reads bytes from a shared ring; only the consumer may call this
+ * Blocks until len bytes have been read, the kernel is only entered to
+ * sleep or to wake a sleeping producer.
+ * @param ring - ring returned by ring_attach
+ * @param buf - buffer to read into
+ * @param len - number of bytes to read
+ */
+void ring_read(ring_t *ring, void *buf, int len);
+
 /*
  * Send a message to the specified mailbox
+ * Blocks while the mailbox is full
  * @param  msg - pointer to the message data structure for the
  *         message to be sent
  * @param  mailbox - mailbox number
@@ -65,6 +291,51 @@ void sem_post(sem_t *sem);
  */
 void msg_send(msg_t *msg, int mbox_num);
 
+/*
+ * Send a message carrying only the first len bytes of its data
+ * @param  msg - pointer to the message data structure for the
+ *         message to be sent
+ * @param  len - number of data bytes to send (0 to MSG_SIZE)
+ * @param  mailbox - mailbox number
+ * @return none
+ */
+void msg_send_len(msg_t *msg, int len, int mbox_num);
+
+/*
+ * Send a message in a priority band; receivers get messages of a higher
+ * band (lower number) first and messages of the same band in FIFO order
+ * Blocks while the mailbox is full
+ * @param  msg - pointer to the message data structure for the
+ *         message to be sent
+ * @param  mailbox - mailbox number
+ * @param  prio - MSG_PRIO_HIGH (0) to MSG_PRIO_LOW; msg_send uses
+ *         MSG_PRIO_DEFAULT
+ * @return none
+ */
+void msg_send_prio(msg_t *msg, int mbox_num, int prio);
+
+/*
+ * Send a message carrying only the first len bytes of its data in a
+ * priority band
+ * @param  msg - pointer to the message data structure for the
+ *         message to be sent
+ * @param  len - number of data bytes to send (0 to MSG_SIZE)
+ * @param  mailbox - mailbox number
+ * @param  prio - MSG_PRIO_HIGH (0) to MSG_PRIO_LOW
+ * @return none
+ */
+void msg_send_prio_len(msg_t *msg, int len, int mbox_num, int prio);
+
+/*
+ * Send a message without blocking if the mailbox is full
+ * @param  msg - pointer to the message data structure for the
+ *         message to be sent
+ * @param  len - number of data bytes to send (0 to MSG_SIZE)
+ * @param  mailbox - mailbox number
+ * @return MSG_OK on success, MSG_ERR_FULL if the mailbox has no room
+ */
+int msg_trysend(msg_t *msg, int len, int mbox_num);
+
 /*
  * Receive a message from the specified mailbox
  * @param  msg - pointer to the message data structure for the
@@ -74,4 +345,103 @@ void msg_send(msg_t *msg, int mbox_num);
  */
 void msg_recv(msg_t *msg, int mbox_num);
 
+/*
+ * Receive a message from the specified mailbox
+ * @param  msg - pointer to the message data structure for the
+ *         received message
+ * @param  mailbox - mailbox number
+ * @return number of data bytes received
+ */
+int msg_recv_len(msg_t *msg, int mbox_num);
+
+/*
+ * Receive a message, waiting at most the given number of milliseconds
+ * @param  msg - pointer to the message data structure for the
+ *         received message
+ * @param  mailbox - mailbox number
+ * @param  ms - longest time to wait (rounded up to timer ticks)
+ * @return number of data bytes received, MSG_ERR_TIMEOUT if no message
+ *         arrived in time
+ */
+int msg_recv_timeout(msg_t *msg, int mbox_num, int ms);
+
+/*
+ * Receive a message without blocking
+ * @param  msg - pointer to the message data structure for the
+ *         received message
+ * @param  mailbox - mailbox number
+ * @return number of data bytes received, MSG_ERR_EMPTY if the mailbox
+ *         has no message
+ */
+int msg_tryrecv(msg_t *msg, int mbox_num);
+
+/*
+ * Wait until any of several mailboxes has a message
+ * The message is left in the mailbox; receive it with msg_recv or
+ * msg_tryrecv (another receiver may take it first).
+ * @param  mbox_set - distinct mailbox numbers to wait on
+ * @param  count - number of mailboxes in the set
+ * @param  ready_mbox - set to a mailbox that has a message
+ * @param  ms - longest time to wait, -1 waits forever, 0 never waits
+ * @return MSG_OK on success, MSG_ERR_TIMEOUT if no message arrived in time,
+ *         MSG_ERR_EMPTY if ms is 0 and no mailbox has a message
+ */
+int msg_select(int *mbox_set, int count, int *ready_mbox, int ms);
+
+/*
+ * Subscribes the calling process to a topic; it receives every message
+ * published from now on
+ * @param  topic_num - topic number (0 to TOPIC_MAX-1)
+ * @return 0 on success, -1 if the topic has no room for more subscribers
+ */
+int topic_subscribe(int topic_num);
+
+/*
+ * Unsubscribes the calling process from a topic, dropping any messages it
+ * has not received
+ * @param  topic_num - topic number
+ */
+void topic_unsubscribe(int topic_num);
+
+/*
+ * Publishes a message to every subscriber of a topic
+ * The data is stored once and shared by all subscribers.
+ * @param  msg - message to publish
+ * @param  len - number of data bytes (0 to MSG_SIZE)
+ * @param  topic_num - topic number
+ * @return MSG_OK on success, MSG_ERR_FULL if no buffer is free or a
+ *         subscriber has too many messages waiting
+ */
+int topic_publish(msg_t *msg, int len, int topic_num);
+
+/*
+ * Receives the next message published to a subscribed topic, waiting
+ * until there is one
+ * @param  msg - where to store the message
+ * @param  topic_num - topic number
+ * @return number of data bytes received
+ */
+int topic_recv(msg_t *msg, int topic_num);
+
+/*
+ * Send a batch of messages to the specified mailbox with one system call
+ * @param  msgs - vector of messages and their data lengths
+ * @param  count - number of messages in the vector
+ * @param  mailbox - mailbox number
+ * @return none
+ */
+void msg_sendv(msg_vec_t *msgs, int count, int mbox_num);
+
+/*
+ * Receive up to max messages from the specified mailbox with one system
+ * call; blocks until at least one message is available
+ * @param  buf - vector of messages to receive into; the length of each
+ *         received message is stored in its entry
+ * @param  max - number of entries in the vector
+ * @param  mailbox - mailbox number
+ * @param  got - set to the number of messages received
+ * @return none
+ */
+void msg_recvv(msg_vec_t *buf, int max, int mbox_num, int *got);
+
 #endif
@@ -19,15 +19,20 @@ typedef struct proc_info_t {
     char name[PROC_NAME_LEN];
 } proc_info_t;
 
-/* "Shared" memory */
-int shared_mem;
+/* Shared memory segment between the dispatcher and printer processes */
+#define SHARED_NAME "proc_info"
+
+typedef struct shared_info_t {
+    mutex_t mutex;                  // Protects the fields below
+    cond_t cond;                    // Signaled when last is updated
+    volatile int ready;             // Set once the mutex and condition variable are initialized
+    int updates;                    // Number of times last was updated
+    proc_info_t last;               // Last process reported to the dispatcher
+} shared_info_t;
 
 /* Mailbox number to send messages */
 int mbox_num = 1;
 
-/* Semaphore */
-sem_t sem = SEMAPHORE_UNINITIALIZED;
-
 void user_proc() {
     int pid;
     int start_time;
@@ -64,7 +69,7 @@ void user_proc() {
 
         if (time - start_time >= 10) {
             cons_printf("time=%04d pid=%02d %s exiting\n", time, pid, name);
-            msg_send(&msg, mbox_num);
+            msg_send_len(&msg, sizeof(proc_info_t), mbox_num);
             proc_exit();
         }
 
@@ -80,6 +85,7 @@ void dispatcher_proc() {
 
     msg_t msg;
     proc_info_t proc_info;
+    shared_info_t *shared;
 
     sp_memset(&name, 0, sizeof(name));
     get_proc_name(name);
@@ -87,7 +93,19 @@ void dispatcher_proc() {
     pid  = get_proc_pid();
     time = get_sys_time();
 
-    sem_init(&sem);
+    // Create the shared memory segment and the objects inside it. The
+    // printer can attach as soon as the segment exists, so it waits for
+    // ready before touching the mutex (ID 0 is a valid mutex).
+    shared = shm_create(SHARED_NAME, sizeof(shared_info_t));
+    if (shared == NULL) {
+        cons_printf("time=%04d pid=%02d %s cannot create shared memory\n", time, pid, name);
+        proc_exit();
+    }
+    shared->mutex = MUTEX_UNINITIALIZED;
+    shared->cond = COND_UNINITIALIZED;
+    mutex_init(&shared->mutex);
+    cond_init(&shared->cond);
+    shared->ready = 1;
 
     cons_printf("time=%04d pid=%02d %s started\n", time, pid, name);
 
@@ -109,16 +127,12 @@ void dispatcher_proc() {
         // Get the current system time
         time = get_sys_time();
 
-        // Wait for the semaphore to be posted by the printer process
-        sem_wait(&sem);
-
-        // Set the shared memory
-        shared_mem = proc_info.pid;
-
-        // Post the semaphore so the printer process can access the shared memory
-        sem_post(&sem);
-
-        sleep(1);
+        // Update the shared memory in place and tell the printer process it changed
+        mutex_lock(&shared->mutex);
+        shared->last = proc_info;
+        shared->updates++;
+        cond_signal(&shared->cond);
+        mutex_unlock(&shared->mutex);
     }
 }
 
@@ -127,7 +141,8 @@ void printer_proc() {
     int time;
     char name[PROC_NAME_LEN];
 
-    int cached_mem = -1;
+    int seen = 0;
+    shared_info_t *shared;
 
     sp_memset(&name, 0, sizeof(name));
     get_proc_name(name);
@@ -135,26 +150,26 @@ void printer_proc() {
     pid  = get_proc_pid();
     time = get_sys_time();
 
-    sem_init(&sem);
+    // Wait for the dispatcher process to create the shared memory and set it up
+    while ((shared = shm_attach(SHARED_NAME)) == NULL) {
+        sleep(1);
+    }
+    while (!shared->ready) {
+        sleep_ms(10);
+    }
 
     cons_printf("time=%04d pid=%02d %s started\n", time, pid, name);
 
+    mutex_lock(&shared->mutex);
     while (1) {
-        // Wait for the semaphore to be posted by the dispatcher process
-        sem_wait(&sem);
-        time = get_sys_time();
-
-        // Only print when we have new data
-        if (cached_mem != shared_mem) {
-            cons_printf("time=%04d pid=%02d %s read shared memory (last pid=%d)\n",
-                         time, pid, name, shared_mem);
-            cached_mem = shared_mem;
+        // Wait for the dispatcher process to store new data
+        while (seen == shared->updates) {
+            cond_wait(&shared->cond, &shared->mutex);
         }
+        time = get_sys_time();
 
-        // Post the semaphore so the dispatcher process can access the shared memory
-        sem_post(&sem);
-
-        // Sleep for one second
-        sleep(1);
+        cons_printf("time=%04d pid=%02d %s read shared memory (last pid=%d, name=%s)\n",
+                     time, pid, name, shared->last.pid, shared->last.name);
+        seen = shared->updates;
     }
 }
@@ -0,0 +1,64 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Shared Kernel Information Page - Kernel Side
+ */
+#include "spede.h"
+#include "kernel.h"
+#include "string.h"
+#include "vdso.h"
+
+/**
+ * Marks the start of a kernel update (sequence count becomes odd)
+ */
+static inline void vdso_write_begin() {
+    vdso.seq++;
+    vdso_barrier();
+}
+
+/**
+ * Marks the end of a kernel update (sequence count becomes even)
+ */
+static inline void vdso_write_end() {
+    vdso_barrier();
+    vdso.seq++;
+}
+
+/**
+ * Initializes the shared page once the time stamp counter is calibrated
+ */
+void vdso_init() {
+
+    sp_memset((char *)&vdso, 0, sizeof(vdso));
+
+    vdso.tick_rate = CLK_TCK;
+    vdso.tsc_boot = tsc_boot;
+    vdso.tsc_khz = tsc_khz;
+    vdso.run_pid = -1;
+
+}
+
+/**
+ * Publishes the system time; called on every timer tick
+ */
+void vdso_update_time() {
+
+    vdso_write_begin();
+    vdso.system_time = system_time;
+    vdso_write_end();
+
+}
+
+/**
+ * Publishes the running process; called on every context switch
+ */
+void vdso_update_proc() {
+
+    vdso_write_begin();
+    vdso.run_pid = run_pid;
+    sp_strcpy(vdso.run_name, pcb[run_pid]->name);
+    vdso_write_end();
+
+}
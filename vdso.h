@@ -0,0 +1,66 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ * Fall 2020
+ *
+ * Shared Kernel Information Page
+ *
+ * The kernel publishes frequently read information in a page that
+ * processes read directly instead of trapping into the kernel. Readers use
+ * a sequence count to detect that the kernel updated the page while it
+ * was being read.
+ */
+#ifndef VDSO_H
+#define VDSO_H
+
+#include "global.h"
+
+#define VDSO_PAGE_SIZE 4096
+
+// Shared information page, padded out to a page of its own so processes
+// can be given a read-only mapping of it
+typedef struct {
+    volatile unsigned int seq;              // Sequence count, odd while the kernel is updating
+    long long system_time;                  // System time (ticks since boot)
+    int tick_rate;                          // Timer ticks per second
+    unsigned long long tsc_boot;            // Time stamp counter value at boot
+    unsigned int tsc_khz;                   // Time stamp counter frequency (kHz)
+    int run_pid;                            // ID of the running process
+    char run_name[PROC_NAME_LEN+1];         // Name of the running process
+} __attribute__((aligned(VDSO_PAGE_SIZE))) vdso_t;
+
+extern vdso_t vdso;
+
+// Prevents the compiler from moving memory accesses across this point
+#define vdso_barrier() asm volatile("" : : : "memory")
+
+/**
+ * Starts reading the shared page
+ * @return sequence count to pass to vdso_read_retry()
+ */
+static inline unsigned int vdso_read_begin() {
+    unsigned int seq;
+
+    while ((seq = vdso.seq) & 1) {
+        // kernel update in progress
+    }
+    vdso_barrier();
+    return seq;
+}
+
+/**
+ * Checks whether the shared page changed while it was being read
+ * @param  seq - sequence count returned by vdso_read_begin()
+ * @return non-zero if the data read must be discarded and read again
+ */
+static inline int vdso_read_retry(unsigned int seq) {
+    vdso_barrier();
+    return vdso.seq != seq;
+}
+
+// Kernel side updates
+void vdso_init();
+void vdso_update_time();
+void vdso_update_proc();
+
+#endif